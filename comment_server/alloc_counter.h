@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+
+size_t LiveHeapBytes();
+
+size_t AllocationCount();
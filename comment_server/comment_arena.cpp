@@ -0,0 +1,37 @@
+#include "comment_arena.h"
+
+#include <cstring>
+#include <stdexcept>
+
+uint32_t CommentArena::AddPage(size_t size) {
+    if (pages_.size() == UINT32_MAX)
+        throw length_error("Comment arena is full");
+
+    pages_.push_back(make_unique<char[]>(size));
+    reserved_bytes_ += size;
+    return static_cast<uint32_t>(pages_.size() - 1);
+}
+
+CommentArena::Ref CommentArena::Append(string_view comment) {
+    const size_t size = comment.size() + 1;
+    if (size > UINT32_MAX)
+        throw length_error("Comment is too long");
+
+    Ref ref{0, 0, static_cast<uint32_t>(size)};
+    if (size > kPageSize) {
+        ref.page = AddPage(size);
+    } else {
+        if (size > kPageSize - open_page_used_) {
+            open_page_ = AddPage(kPageSize);
+            open_page_used_ = 0;
+        }
+        ref.page = open_page_;
+        ref.offset = static_cast<uint32_t>(open_page_used_);
+        open_page_used_ += size;
+    }
+
+    char* destination = pages_[ref.page].get() + ref.offset;
+    memcpy(destination, comment.data(), comment.size());
+    destination[comment.size()] = '\n';
+    return ref;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Append-only storage for newline-terminated comments in large pages. Stored text never moves, so
+// views stay valid as long as the arena, and comments appended one after another sit contiguously.
+class CommentArena {
+public:
+    // Where a comment lives: 12 bytes instead of a string per comment
+    struct Ref {
+        uint32_t page, offset, size;
+    };
+
+    static constexpr size_t kPageSize = 64 * 1024;
+
+    Ref Append(string_view comment);
+
+    string_view View(Ref ref) const {
+        return {pages_[ref.page].get() + ref.offset, ref.size};
+    }
+
+    size_t ReservedBytes() const {
+        return reserved_bytes_;
+    }
+
+private:
+    vector<unique_ptr<char[]>> pages_;
+    // The page being filled; comments too long for a page get one of their own
+    uint32_t open_page_ = 0;
+    size_t open_page_used_ = kPageSize;
+    size_t reserved_bytes_ = 0;
+
+    uint32_t AddPage(size_t size);
+};
@@ -0,0 +1,234 @@
+#include "comment_log.h"
+#include "file_io.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint64_t kLogMagic = 0x314c5443ull;
+    constexpr size_t kHeaderSize = sizeof(uint64_t);
+
+    template <typename Int>
+    void WriteInt(string& output, Int value) {
+        output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename Int>
+    bool ReadInt(string_view& input, Int& value) {
+        if (input.size() < sizeof(value))
+            return false;
+
+        memcpy(&value, input.data(), sizeof(value));
+        input.remove_prefix(sizeof(value));
+        return true;
+    }
+
+    uint32_t Checksum(string_view data) {
+        uint32_t hash = 2166136261u;
+        for (char c : data) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    bool DecodeEvent(string_view payload, CommentLogEvent& event) {
+        uint8_t op;
+        uint64_t user_id;
+        if (!ReadInt(payload, op) || op < 1 || op > 4 || !ReadInt(payload, user_id))
+            return false;
+
+        event.op = static_cast<CommentLogOp>(op);
+        event.user_id = user_id;
+        event.comment = payload;
+        return event.op == CommentLogOp::AddComment || payload.empty();
+    }
+}
+
+CommentLogContents ReadCommentLog(const string& path) {
+    const optional<string> data = ReadFile(path);
+    // A log cut off inside its header never held an event
+    if (!data || data->size() < kHeaderSize)
+        return {{}, 0};
+
+    string_view rest = *data;
+    uint64_t magic;
+    if (!ReadInt(rest, magic) || magic != kLogMagic)
+        throw runtime_error("Not a comment log: " + path);
+
+    CommentLogContents contents{{}, kHeaderSize};
+    while (true) {
+        uint32_t size, checksum;
+        if (!ReadInt(rest, size) || rest.size() < size + sizeof(checksum))
+            break;
+
+        const string_view payload = rest.substr(0, size);
+        rest.remove_prefix(size);
+
+        CommentLogEvent event;
+        if (!ReadInt(rest, checksum) || Checksum(payload) != checksum || !DecodeEvent(payload, event))
+            break;
+
+        contents.events.push_back(move(event));
+        contents.valid_size = data->size() - rest.size();
+    }
+
+    return contents;
+}
+
+CommentLog::CommentLog(const string& path, size_t valid_size, CommentLogOptions options)
+    : options_(options) {
+    options_.group_commit_size = max<size_t>(options_.group_commit_size, 1);
+    const bool append = valid_size >= kHeaderSize;
+
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), 0644);
+    if (fd_ < 0)
+        throw runtime_error("Unable to open the comment log " + path);
+
+    if (append) {
+        if (ftruncate(fd_, valid_size) != 0 || lseek(fd_, 0, SEEK_END) < 0) {
+            close(fd_);
+            throw runtime_error("Unable to reopen the comment log " + path);
+        }
+    } else {
+        WriteInt(buffer_, kLogMagic);
+        try {
+            Sync();
+        } catch (exception&) {
+            close(fd_);
+            throw;
+        }
+    }
+
+    if (options_.sync_policy != SyncPolicy::Always)
+        flusher_ = thread([this] { FlushOnDeadline(); });
+}
+
+CommentLog::~CommentLog() {
+    if (flusher_.joinable()) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        flusher_wakeup_.notify_one();
+        flusher_.join();
+    }
+
+    try {
+        Sync();
+    } catch (exception&) {
+    }
+    close(fd_);
+}
+
+uint64_t CommentLog::Append(CommentLogOp op, size_t user_id, string_view comment) {
+    lock_guard<mutex> lock(mutex_);
+    ThrowIfFailed();
+
+    if (buffer_.empty()) {
+        oldest_pending_ = chrono::steady_clock::now();
+        flusher_wakeup_.notify_one();
+    }
+
+    const size_t entry_start = buffer_.size();
+    WriteInt(buffer_, uint32_t{0});
+    WriteInt(buffer_, static_cast<uint8_t>(op));
+    WriteInt(buffer_, static_cast<uint64_t>(user_id));
+    buffer_.append(comment);
+
+    const size_t payload_start = entry_start + sizeof(uint32_t);
+    const auto size = static_cast<uint32_t>(buffer_.size() - payload_start);
+    memcpy(&buffer_[entry_start], &size, sizeof(size));
+    WriteInt(buffer_, Checksum(string_view(buffer_).substr(payload_start)));
+
+    return ++appended_;
+}
+
+void CommentLog::Commit(uint64_t sequence) {
+    unique_lock<mutex> lock(mutex_);
+    ThrowIfFailed();
+
+    if (options_.sync_policy != SyncPolicy::Always) {
+        if (!committing_ && appended_ - committed_sequence_ >= options_.group_commit_size)
+            WriteBuffered(lock, options_.sync_policy == SyncPolicy::Grouped);
+        return;
+    }
+
+    // Whoever finds no write in flight writes out the whole buffer, including the events of
+    // everyone who appended while the previous fdatasync was running
+    while (committed_sequence_ < sequence) {
+        if (committing_)
+            committed_.wait(lock);
+        else
+            WriteBuffered(lock, true);
+        ThrowIfFailed();
+    }
+}
+
+void CommentLog::Sync() {
+    unique_lock<mutex> lock(mutex_);
+    while (committing_) {
+        committed_.wait(lock);
+    }
+    ThrowIfFailed();
+    WriteBuffered(lock, options_.sync_policy != SyncPolicy::Never);
+}
+
+void CommentLog::ThrowIfFailed() const {
+    if (failed_)
+        throw runtime_error("The comment log failed to write and accepts no more events");
+}
+
+void CommentLog::FlushOnDeadline() {
+    unique_lock<mutex> lock(mutex_);
+    while (!stopping_ && !failed_) {
+        if (buffer_.empty() || committing_) {
+            flusher_wakeup_.wait(lock);
+            continue;
+        }
+
+        if (const auto deadline = oldest_pending_ + options_.max_commit_delay;
+                chrono::steady_clock::now() < deadline) {
+            flusher_wakeup_.wait_until(lock, deadline);
+            continue;
+        }
+
+        try {
+            WriteBuffered(lock, options_.sync_policy == SyncPolicy::Grouped);
+        } catch (exception&) {
+        }
+    }
+}
+
+void CommentLog::WriteBuffered(unique_lock<mutex>& lock, bool sync) {
+    if (buffer_.empty())
+        return;
+
+    committing_ = true;
+    swap(buffer_, writing_);
+    const uint64_t sequence = appended_;
+    lock.unlock();
+
+    bool written = false;
+    try {
+        WriteAll(fd_, writing_);
+        written = !sync || fdatasync(fd_) == 0;
+    } catch (exception&) {
+    }
+    writing_.clear();
+
+    lock.lock();
+    committing_ = false;
+    // A partial record may now sit on disk and the events in it are lost, so nothing after
+    // them may be reported as durable
+    if (written)
+        committed_sequence_ = sequence;
+    else
+        failed_ = true;
+    committed_.notify_all();
+    flusher_wakeup_.notify_one();
+
+    ThrowIfFailed();
+}
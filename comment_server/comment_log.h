@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+enum class CommentLogOp : uint8_t {
+    AddUser = 1,
+    AddComment = 2,
+    Ban = 3,
+    Unban = 4,
+};
+
+struct CommentLogEvent {
+    CommentLogOp op;
+    size_t user_id;
+    string comment;
+};
+
+struct CommentLogContents {
+    vector<CommentLogEvent> events;
+    size_t valid_size;
+};
+
+// Stops at the first torn or corrupted event; valid_size is where appending may resume.
+// A missing log reads as empty.
+CommentLogContents ReadCommentLog(const string& path);
+
+enum class SyncPolicy {
+    // A request is answered once its event is on disk; concurrent requests share one fdatasync
+    Always,
+    // Events are written and fdatasynced once per group; a crash loses at most the last group
+    Grouped,
+    // Events are written once per group and the OS decides when they reach the disk
+    Never,
+};
+
+struct CommentLogOptions {
+    SyncPolicy sync_policy = SyncPolicy::Grouped;
+    size_t group_commit_size = 128;
+    // Under Grouped and Never an incomplete group is written once its oldest event is this old,
+    // so on a quiet server a crash loses only the events answered within the last max_commit_delay
+    chrono::milliseconds max_commit_delay{100};
+};
+
+// Append-only event log, safe to call from many threads. Append only fills a buffer; Commit then
+// writes it out as the sync policy requires, one writer at a time, so events reach the file in
+// append order. After a failed write or fdatasync the log refuses all further calls by throwing.
+class CommentLog {
+public:
+    // Appends after valid_size, dropping anything past it, or starts a new log when it is 0
+    CommentLog(const string& path, size_t valid_size, CommentLogOptions options);
+
+    CommentLog(const CommentLog&) = delete;
+    CommentLog& operator=(const CommentLog&) = delete;
+
+    ~CommentLog();
+
+    // Returns the event's sequence number for Commit. Never touches the disk, so it may be called
+    // under the caller's locks.
+    uint64_t Append(CommentLogOp op, size_t user_id, string_view comment = {});
+
+    // Under SyncPolicy::Always blocks until the event is on disk; otherwise writes the buffer once
+    // a group is complete
+    void Commit(uint64_t sequence);
+
+    // Writes and syncs everything appended so far
+    void Sync();
+
+private:
+    int fd_ = -1;
+    CommentLogOptions options_;
+
+    mutex mutex_;
+    condition_variable committed_;
+    string buffer_;
+    string writing_;
+    uint64_t appended_ = 0;
+    uint64_t committed_sequence_ = 0;
+    bool committing_ = false;
+    bool failed_ = false;
+
+    chrono::steady_clock::time_point oldest_pending_;
+    condition_variable flusher_wakeup_;
+    bool stopping_ = false;
+    thread flusher_;
+
+    void ThrowIfFailed() const;
+
+    // Runs on flusher_ and writes out groups that wait longer than max_commit_delay
+    void FlushOnDeadline();
+
+    void WriteBuffered(unique_lock<mutex>& lock, bool sync);
+};
@@ -0,0 +1,216 @@
+#include "comment_server.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+pair<size_t, string_view> ParseIdAndContent(string_view body) {
+    auto [id_string, content] = SplitBy(body, " ");
+    return {FromString<size_t>(id_string), content};
+}
+
+CommentServer::CommentServer(const string& log_path, CommentLogOptions log_options) {
+    const CommentLogContents contents = ReadCommentLog(log_path);
+    for (const CommentLogEvent& event : contents.events) {
+        Replay(event);
+    }
+    log_ = make_unique<CommentLog>(log_path, contents.valid_size, log_options);
+}
+
+const RouteTable<CommentServer::Handler>& CommentServer::Routes() {
+    static const RouteTable<Handler> routes({
+        {"POST", "/add_user", &CommentServer::AddUser},
+        {"POST", "/add_comment", &CommentServer::AddComment},
+        {"POST", "/checkcaptcha", &CommentServer::CheckCaptcha},
+        {"GET", "/user_comments", &CommentServer::UserComments},
+        {"GET", "/captcha", &CommentServer::Captcha},
+    });
+    return routes;
+}
+
+HttpResponse CommentServer::ServeRequest(const HttpRequest& req) {
+    if (const Handler* handler = Routes().Find(req.method, req.path))
+        return (this->**handler)(req);
+
+    return HttpResponse(HttpCode::NotFound);
+}
+
+CommentServer::Shard& CommentServer::ShardOf(size_t user_id) {
+    return shards_[user_id % kShardCount];
+}
+
+uint64_t CommentServer::PackLastComment(LastCommentInfo info) {
+    return static_cast<uint64_t>(info.user_id) << 16 | min<size_t>(info.consecutive_count, 0xFFFF);
+}
+
+optional<LastCommentInfo> CommentServer::UnpackLastComment(uint64_t packed) {
+    if (packed == kNoLastComment)
+        return nullopt;
+    return LastCommentInfo{static_cast<size_t>(packed >> 16), static_cast<size_t>(packed & 0xFFFF)};
+}
+
+LastCommentInfo CommentServer::RecordComment(size_t user_id) {
+    if (user_id >= (uint64_t{1} << 48) - 1)
+        throw out_of_range("User id is too large");
+
+    uint64_t current = last_comment_.load();
+    LastCommentInfo next;
+    do {
+        const auto last = UnpackLastComment(current);
+        next = !last || last->user_id != user_id
+                ? LastCommentInfo{user_id, 1}
+                : LastCommentInfo{user_id, last->consecutive_count + 1};
+    } while (!last_comment_.compare_exchange_weak(current, PackLastComment(next)));
+
+    return next;
+}
+
+void CommentServer::ForgetLastComment(size_t user_id) {
+    uint64_t current = last_comment_.load();
+    while (true) {
+        const auto last = UnpackLastComment(current);
+        if (!last || last->user_id != user_id
+                || last_comment_.compare_exchange_weak(current, kNoLastComment))
+            return;
+    }
+}
+
+void CommentServer::Replay(const CommentLogEvent& event) {
+    auto& users = ShardOf(event.user_id).users;
+    switch (event.op) {
+        case CommentLogOp::AddUser:
+            users.try_emplace(event.user_id);
+            user_count_ = max<size_t>(user_count_, event.user_id + 1);
+            break;
+
+        case CommentLogOp::AddComment:
+            users.at(event.user_id).comments.push_back(ShardOf(event.user_id).arena.Append(event.comment));
+            break;
+
+        case CommentLogOp::Ban:
+            users.at(event.user_id).banned = true;
+            break;
+
+        case CommentLogOp::Unban:
+            if (auto it = users.find(event.user_id); it != users.end())
+                it->second.banned = false;
+            break;
+    }
+}
+
+uint64_t CommentServer::Log(CommentLogOp op, size_t user_id, string_view comment) {
+    return log_ ? log_->Append(op, user_id, comment) : 0;
+}
+
+void CommentServer::Commit(uint64_t sequence) {
+    if (log_ && sequence > 0)
+        log_->Commit(sequence);
+}
+
+HttpResponse CommentServer::AddUser(const HttpRequest&) {
+    HttpResponse res(HttpCode::Ok);
+    const size_t user_id = user_count_.fetch_add(1);
+    uint64_t sequence;
+    {
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.guard);
+        shard.users.try_emplace(user_id);
+        sequence = Log(CommentLogOp::AddUser, user_id);
+    }
+    Commit(sequence);
+    res.SetContent(to_string(user_id));
+    return res;
+}
+
+HttpResponse CommentServer::AddComment(const HttpRequest& req) {
+    HttpResponse res(HttpCode::Ok);
+    auto [user_id, comment] = ParseIdAndContent(req.body);
+    uint64_t sequence = 0;
+
+    {
+        // The streak is advanced under the user's lock, so one user's comments and captchas apply in
+        // the order they advanced it; other users only meet them through the compare-and-swap
+        Shard& shard = ShardOf(user_id);
+        lock_guard<mutex> lock(shard.guard);
+        UserState& user = shard.users.at(user_id);
+
+        if (RecordComment(user_id).consecutive_count > 3 && !user.banned) {
+            user.banned = true;
+            sequence = Log(CommentLogOp::Ban, user_id);
+        }
+
+        if (!user.banned) {
+            user.comments.push_back(shard.arena.Append(comment));
+            sequence = Log(CommentLogOp::AddComment, user_id, comment);
+        }
+        else {
+            res.SetCode(HttpCode::Found);
+            res.AddHeader("Location", "/captcha");
+        }
+    }
+
+    Commit(sequence);
+    return res;
+}
+
+HttpResponse CommentServer::CheckCaptcha(const HttpRequest& req) {
+    HttpResponse res(HttpCode::Ok);
+
+    if (auto [id, response] = ParseIdAndContent(req.body); response == "42") {
+        uint64_t sequence;
+        {
+            Shard& shard = ShardOf(id);
+            lock_guard<mutex> lock(shard.guard);
+            if (auto it = shard.users.find(id); it != shard.users.end())
+                it->second.banned = false;
+
+            ForgetLastComment(id);
+            sequence = Log(CommentLogOp::Unban, id);
+        }
+        Commit(sequence);
+    }
+    else {
+        res.SetCode(HttpCode::Found);
+        res.AddHeader("Location", "/captcha");
+    }
+
+    return res;
+}
+
+HttpResponse CommentServer::UserComments(const HttpRequest& req) {
+    HttpResponse res(HttpCode::Ok);
+    auto user_id = FromString<size_t>(req.get_params.At("user_id"));
+    const auto offset_param = req.get_params.Find("offset");
+    const auto limit_param = req.get_params.Find("limit");
+    const size_t offset = offset_param ? FromString<size_t>(*offset_param) : 0;
+    const size_t limit = limit_param ? FromString<size_t>(*limit_param) : SIZE_MAX;
+
+    Shard& shard = ShardOf(user_id);
+    lock_guard<mutex> lock(shard.guard);
+    const vector<CommentArena::Ref>& comments = shard.users.at(user_id).comments;
+
+    // The page ends where the history ended when the request came in; comments are only ever
+    // appended, so the offset after it is a stable cursor for the next page
+    const size_t begin = min(offset, comments.size());
+    const size_t end = begin + min(limit, comments.size() - begin);
+    if (end < comments.size())
+        res.AddHeader("X-Next-Offset", to_string(end));
+
+    res.SetContentStream([&shard, &comments, next = begin, end](vector<string_view>& fragments) mutable {
+        lock_guard<mutex> lock(shard.guard);
+        for (const size_t chunk_end = min(end, next + kCommentsPerChunk); next < chunk_end; ++next) {
+            // A user's comments that landed next to each other in the arena go out as one fragment
+            const string_view comment = shard.arena.View(comments[next]);
+            if (!fragments.empty() && fragments.back().data() + fragments.back().size() == comment.data())
+                fragments.back() = {fragments.back().data(), fragments.back().size() + comment.size()};
+            else
+                fragments.push_back(comment);
+        }
+    });
+    return res;
+}
+
+HttpResponse CommentServer::Captcha(const HttpRequest&) {
+    HttpResponse res(HttpCode::Ok);
+    res.SetContent("What's the answer for The Ultimate Question of Life, the Universe, and Everything?");
+    return res;
+}
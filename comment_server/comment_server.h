@@ -0,0 +1,97 @@
+#pragma once
+
+#include "comment_arena.h"
+#include "comment_log.h"
+#include "http.h"
+#include "route_table.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+pair<size_t, string_view> ParseIdAndContent(string_view body);
+
+struct LastCommentInfo {
+    size_t user_id, consecutive_count;
+};
+
+// Safe to call from many threads. Users are spread over lock-striped shards, and the "last comment"
+// spam detector is a single atomic word updated by compare-and-swap. Each shard appends its comments
+// to an arena and keeps a list of arena refs per user, so /user_comments responses view them in place.
+// A listing is a page of comments (offset and limit parameters, both optional) streamed with chunked
+// transfer encoding, so a request holds at most kCommentsPerChunk views however long the history is.
+// With a log path, new users, accepted comments, bans and unbans are appended to a CommentLog and
+// replayed at construction. The spam streak is not logged, so after a restart it starts empty, as after
+// a captcha.
+class CommentServer {
+private:
+    struct UserState {
+        vector<CommentArena::Ref> comments;
+        bool banned = false;
+    };
+
+    struct alignas(64) Shard {
+        mutex guard;
+        unordered_map<size_t, UserState> users;
+        CommentArena arena;
+    };
+
+    static constexpr size_t kShardCount = 64;
+    static constexpr uint64_t kNoLastComment = UINT64_MAX;
+    static constexpr size_t kCommentsPerChunk = 128;
+
+    array<Shard, kShardCount> shards_;
+    atomic<size_t> user_count_{0};
+    atomic<uint64_t> last_comment_{kNoLastComment};
+    unique_ptr<CommentLog> log_;
+
+    using Handler = HttpResponse (CommentServer::*)(const HttpRequest&);
+
+    static const RouteTable<Handler>& Routes();
+
+    Shard& ShardOf(size_t user_id);
+
+    static uint64_t PackLastComment(LastCommentInfo info);
+
+    static optional<LastCommentInfo> UnpackLastComment(uint64_t packed);
+
+    // Makes user_id the author of the last comment and returns the updated streak
+    LastCommentInfo RecordComment(size_t user_id);
+
+    void ForgetLastComment(size_t user_id);
+
+    void Replay(const CommentLogEvent& event);
+
+    // Both are no-ops without a log. Log is called under the user's shard lock so that the log keeps
+    // each user's events in order, and Commit after it is released, since it may write and sync.
+    uint64_t Log(CommentLogOp op, size_t user_id, string_view comment = {});
+
+    void Commit(uint64_t sequence);
+
+    HttpResponse AddUser(const HttpRequest& req);
+
+    HttpResponse AddComment(const HttpRequest& req);
+
+    HttpResponse CheckCaptcha(const HttpRequest& req);
+
+    HttpResponse UserComments(const HttpRequest& req);
+
+    HttpResponse Captcha(const HttpRequest& req);
+
+public:
+    CommentServer() = default;
+
+    explicit CommentServer(const string& log_path, CommentLogOptions log_options = {});
+
+    HttpResponse ServeRequest(const HttpRequest& req);
+};
@@ -0,0 +1,358 @@
+#include "epoll_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    const size_t kReadChunkSize = 64 * 1024;
+    const int kMaxEvents = 64;
+    const size_t kMaxWriteBuffers = 256;
+    // Back-pressure for clients that pipeline without reading: no more input is read or parsed while
+    // this many responses wait to be written, and one read pass takes at most kMaxReadBatch bytes
+    const size_t kMaxQueuedResponses = 256;
+    const size_t kMaxReadBatch = 256 * 1024;
+
+    void AddToEpoll(int epoll_fd, int fd, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+            throw runtime_error("Unable to register a descriptor in epoll");
+    }
+}
+
+EpollServer::EpollServer(Handler handler, const string& address, uint16_t port, size_t thread_count)
+    : handler_(move(handler)), loops_(max<size_t>(thread_count, 1)) {
+    try {
+        stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (stop_fd_ < 0)
+            throw runtime_error("Unable to create server descriptors");
+
+        port_ = port;
+        for (Loop& loop : loops_) {
+            OpenLoop(loop, address, port_, loops_.size() > 1);
+        }
+    } catch (...) {
+        CloseDescriptors();
+        throw;
+    }
+}
+
+EpollServer::~EpollServer() {
+    CloseDescriptors();
+}
+
+uint16_t EpollServer::Port() const {
+    return port_;
+}
+
+void EpollServer::Run() {
+    vector<thread> workers;
+    for (size_t i = 1; i < loops_.size(); ++i) {
+        workers.emplace_back([this, i] {
+            RunLoop(loops_[i]);
+        });
+    }
+
+    try {
+        RunLoop(loops_[0]);
+    } catch (...) {
+        Stop();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        throw;
+    }
+
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void EpollServer::Stop() {
+    const uint64_t value = 1;
+    [[maybe_unused]] ssize_t size = write(stop_fd_, &value, sizeof(value));
+}
+
+void EpollServer::OpenLoop(Loop& loop, const string& address, uint16_t port, bool reuse_port) {
+    sockaddr_in socket_address{};
+    socket_address.sin_family = AF_INET;
+    socket_address.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &socket_address.sin_addr) != 1)
+        throw invalid_argument("Bad listen address " + address);
+
+    loop.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop.listen_fd < 0 || loop.epoll_fd < 0)
+        throw runtime_error("Unable to create server descriptors");
+
+    const int enable = 1;
+    setsockopt(loop.listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (reuse_port)
+        setsockopt(loop.listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+
+    socklen_t address_size = sizeof(socket_address);
+    if (bind(loop.listen_fd, reinterpret_cast<sockaddr*>(&socket_address), sizeof(socket_address)) != 0
+            || listen(loop.listen_fd, SOMAXCONN) != 0
+            || getsockname(loop.listen_fd, reinterpret_cast<sockaddr*>(&socket_address), &address_size) != 0)
+        throw runtime_error("Unable to listen on " + address + ":" + to_string(port));
+    port_ = ntohs(socket_address.sin_port);
+
+    AddToEpoll(loop.epoll_fd, loop.listen_fd, EPOLLIN | EPOLLET);
+    // Level-triggered and never drained, so every loop sees the stop signal
+    AddToEpoll(loop.epoll_fd, stop_fd_, EPOLLIN);
+}
+
+void EpollServer::RunLoop(Loop& loop) {
+    epoll_event events[kMaxEvents];
+
+    while (true) {
+        const int ready = epoll_wait(loop.epoll_fd, events, kMaxEvents, -1);
+        if (ready < 0) {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error("epoll_wait failed");
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            const int fd = events[i].data.fd;
+
+            if (fd == stop_fd_)
+                return;
+
+            if (fd == loop.listen_fd) {
+                AcceptAll(loop);
+                continue;
+            }
+
+            auto it = loop.connections.find(fd);
+            if (it == loop.connections.end())
+                continue;
+
+            Connection& connection = *it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                CloseConnection(loop, fd);
+                continue;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+                connection.unread_input = true;
+
+            Pump(connection);
+            if (connection.output.empty() && (connection.close_after_write || connection.peer_closed))
+                CloseConnection(loop, fd);
+        }
+    }
+}
+
+void EpollServer::AcceptAll(Loop& loop) {
+    while (true) {
+        const int fd = accept4(loop.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+
+        const int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        try {
+            AddToEpoll(loop.epoll_fd, fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        } catch (const exception&) {
+            close(fd);
+            continue;
+        }
+
+        auto connection = make_unique<Connection>();
+        connection->fd = fd;
+        loop.connections[fd] = move(connection);
+    }
+}
+
+void EpollServer::Pump(Connection& connection) {
+    bool progressed = true;
+    while (progressed) {
+        progressed = false;
+        if (connection.unread_input && connection.output.size() < kMaxQueuedResponses)
+            progressed = ReadSome(connection);
+
+        progressed = ServePending(connection) || progressed;
+        progressed = Flush(connection) || progressed;
+    }
+}
+
+bool EpollServer::ReadSome(Connection& connection) {
+    char buffer[kReadChunkSize];
+    size_t total = 0;
+
+    while (total < kMaxReadBatch) {
+        const ssize_t size = read(connection.fd, buffer, sizeof(buffer));
+        if (size > 0) {
+            connection.parser.Feed({buffer, static_cast<size_t>(size)});
+            total += size;
+            continue;
+        }
+
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        if (size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            connection.peer_closed = true;
+        connection.unread_input = false;
+        break;
+    }
+
+    return total > 0;
+}
+
+bool EpollServer::ServePending(Connection& connection) {
+    bool served = false;
+
+    while (!connection.close_after_write && connection.output.size() < kMaxQueuedResponses) {
+        optional<HttpRequest> request;
+        try {
+            request = connection.parser.Next();
+        } catch (const exception&) {
+            HttpResponse response(HttpCode::BadRequest);
+            response.AddHeader("Connection", "close");
+            Enqueue(connection, move(response));
+            connection.close_after_write = true;
+            return true;
+        }
+
+        if (!request)
+            break;
+
+        // A request with a bad or missing parameter is answered with 400. Any other failure is the
+        // server's own, e.g. a comment log that can't be written, so the connection is given up.
+        HttpResponse response(HttpCode::BadRequest);
+        try {
+            response = handler_(*request);
+        } catch (const invalid_argument&) {
+        } catch (const out_of_range&) {
+        } catch (const exception&) {
+            response = HttpResponse(HttpCode::InternalServerError);
+            request->keep_alive = false;
+        }
+
+        // HTTP/1.0 has no chunked encoding, so a streamed body there ends with the connection
+        if (request->version == "HTTP/1.0" && response.HasMoreChunks()) {
+            response.SetCloseDelimited();
+            request->keep_alive = false;
+        }
+
+        if (!request->keep_alive) {
+            response.AddHeader("Connection", "close");
+            connection.close_after_write = true;
+        }
+
+        Enqueue(connection, move(response));
+        served = true;
+    }
+
+    return served;
+}
+
+void EpollServer::Enqueue(Connection& connection, HttpResponse response) {
+    PendingResponse& pending = connection.output.emplace_back(move(response));
+    pending.response.AppendTo(pending.head, pending.buffers);
+}
+
+bool EpollServer::Flush(Connection& connection) {
+    auto& output = connection.output;
+    bool wrote = false;
+
+    while (!output.empty()) {
+        iovec batch[kMaxWriteBuffers];
+        size_t batch_size = 0;
+        for (auto it = output.begin(); it != output.end() && batch_size < kMaxWriteBuffers; ++it) {
+            for (size_t i = it->next_buffer; i < it->buffers.size() && batch_size < kMaxWriteBuffers; ++i) {
+                batch[batch_size++] = it->buffers[i];
+            }
+            // Later responses wait until every chunk of a streamed body has gone out
+            if (it->response.HasMoreChunks())
+                break;
+        }
+
+        msghdr message{};
+        message.msg_iov = batch;
+        message.msg_iovlen = batch_size;
+        ssize_t written = sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.peer_closed = true;
+                connection.close_after_write = true;
+                connection.unread_input = false;
+                output.clear();
+            }
+            return wrote;
+        }
+        wrote = wrote || written > 0;
+
+        while (!output.empty()) {
+            PendingResponse& front = output.front();
+            while (front.next_buffer < front.buffers.size()) {
+                iovec& buffer = front.buffers[front.next_buffer];
+                const size_t consumed = min(buffer.iov_len, static_cast<size_t>(written));
+                buffer.iov_base = static_cast<char*>(buffer.iov_base) + consumed;
+                buffer.iov_len -= consumed;
+                written -= consumed;
+
+                if (buffer.iov_len > 0)
+                    break;
+                ++front.next_buffer;
+            }
+
+            if (front.next_buffer < front.buffers.size())
+                break;
+
+            if (front.response.HasMoreChunks()) {
+                front.buffers.clear();
+                front.next_buffer = 0;
+                front.response.AppendNextChunk(front.buffers);
+                if (!front.buffers.empty())
+                    break;
+            }
+            output.pop_front();
+        }
+    }
+
+    return wrote;
+}
+
+void EpollServer::CloseDescriptors() {
+    for (Loop& loop : loops_) {
+        for (const auto& [fd, connection] : loop.connections) {
+            close(fd);
+        }
+        loop.connections.clear();
+
+        for (int fd : {loop.listen_fd, loop.epoll_fd}) {
+            if (fd >= 0)
+                close(fd);
+        }
+        loop.listen_fd = loop.epoll_fd = -1;
+    }
+
+    if (stop_fd_ >= 0)
+        close(stop_fd_);
+    stop_fd_ = -1;
+}
+
+void EpollServer::CloseConnection(Loop& loop, int fd) {
+    close(fd);
+    loop.connections.erase(fd);
+}
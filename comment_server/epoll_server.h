@@ -0,0 +1,93 @@
+#pragma once
+
+#include "http.h"
+#include "http_request_parser.h"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// HTTP/1.1 front end on edge-triggered epoll loops. Connections are kept alive and pipelined
+// requests are answered in order. With several threads each runs its own loop and listening
+// socket on the shared port (SO_REUSEPORT), so the handler must be thread-safe.
+// Run blocks until Stop is called from any thread.
+class EpollServer {
+public:
+    using Handler = function<HttpResponse(const HttpRequest&)>;
+
+    // Port 0 picks a free port, see Port()
+    EpollServer(Handler handler, const string& address = "127.0.0.1", uint16_t port = 0, size_t thread_count = 1);
+
+    ~EpollServer();
+
+    EpollServer(const EpollServer&) = delete;
+    EpollServer& operator=(const EpollServer&) = delete;
+
+    uint16_t Port() const;
+
+    void Run();
+
+    void Stop();
+
+private:
+    // A response waiting to be written; buffers point into head and response. A streamed body is
+    // pulled into buffers one chunk at a time, once the previous chunk has been sent.
+    struct PendingResponse {
+        explicit PendingResponse(HttpResponse response) : response(move(response)) {}
+
+        HttpResponse response;
+        string head;
+        vector<iovec> buffers;
+        size_t next_buffer = 0;
+    };
+
+    struct Connection {
+        int fd;
+        HttpRequestParser parser;
+        deque<PendingResponse> output;
+        // Set on EPOLLIN and cleared once a read reaches EAGAIN; with edge-triggered events
+        // input left in the socket by back-pressure would otherwise never be reported again
+        bool unread_input = false;
+        bool peer_closed = false;
+        bool close_after_write = false;
+    };
+
+    struct Loop {
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        unordered_map<int, unique_ptr<Connection>> connections;
+    };
+
+    Handler handler_;
+    int stop_fd_ = -1;
+    uint16_t port_ = 0;
+    vector<Loop> loops_;
+
+    void OpenLoop(Loop& loop, const string& address, uint16_t port, bool reuse_port);
+
+    void RunLoop(Loop& loop);
+
+    static void AcceptAll(Loop& loop);
+
+    // Reads, serves and writes until none of them can make progress
+    void Pump(Connection& connection);
+
+    // ReadSome, ServePending and Flush return whether they made progress
+    static bool ReadSome(Connection& connection);
+
+    bool ServePending(Connection& connection);
+
+    static void Enqueue(Connection& connection, HttpResponse response);
+
+    static bool Flush(Connection& connection);
+
+    static void CloseConnection(Loop& loop, int fd);
+
+    void CloseDescriptors();
+};
@@ -0,0 +1,28 @@
+#include "file_io.h"
+
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <unistd.h>
+
+optional<string> ReadFile(const string& path) {
+    ifstream input(path, ios::binary);
+    if (!input)
+        return nullopt;
+
+    return string((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+}
+
+void WriteAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            throw runtime_error("Unable to write to a file");
+
+        data.remove_prefix(written);
+    }
+}
@@ -0,0 +1,175 @@
+#include "http.h"
+
+HttpParams::HttpParams(initializer_list<Param> params) {
+    for (const auto& [name, value] : params) {
+        Add(name, value);
+    }
+}
+
+void HttpParams::Add(string_view name, string_view value) {
+    if (size_ < kInlineCapacity) {
+        inline_[size_++] = {name, value};
+        return;
+    }
+
+    if (spilled_.empty())
+        spilled_.assign(inline_.begin(), inline_.end());
+    spilled_.push_back({name, value});
+    ++size_;
+}
+
+optional<string_view> HttpParams::Find(string_view name) const {
+    for (const auto& [param_name, value] : *this) {
+        if (param_name == name)
+            return value;
+    }
+    return nullopt;
+}
+
+string_view HttpParams::At(string_view name) const {
+    if (auto value = Find(name))
+        return *value;
+    throw out_of_range("No parameter " + string(name));
+}
+
+string_view ReasonPhrase(HttpCode code) {
+    switch (code) {
+        case HttpCode::Ok:
+            return "OK";
+
+        case HttpCode::NotFound:
+            return "Not found";
+
+        case HttpCode::Found:
+            return "Found";
+
+        case HttpCode::BadRequest:
+            return "Bad request";
+
+        case HttpCode::InternalServerError:
+            return "Internal server error";
+    }
+
+    return {};
+}
+
+ostream& operator<<(ostream& os, const HttpCode& code) {
+    return os << static_cast<int>(code) << " " << ReasonPhrase(code);
+}
+
+void HttpResponse::FormatHead(string& head) const {
+    head += "HTTP/1.1 ";
+    head += to_string(static_cast<int>(code_));
+    head += ' ';
+    head += ReasonPhrase(code_);
+    head += "\r\n";
+
+    for (const auto& [name, value] : headers_) {
+        head += name;
+        head += ": ";
+        head += value;
+        head += "\r\n";
+    }
+
+    if (content_stream_ && close_delimited_) {
+        head += "\r\n";
+    } else if (content_stream_) {
+        head += "Transfer-Encoding: chunked\r\n\r\n";
+    } else {
+        head += "Content-Length: ";
+        head += to_string(ContentLength());
+        head += "\r\n\r\n";
+    }
+}
+
+void HttpResponse::AppendTo(string& head, vector<iovec>& buffers) const {
+    head.clear();
+    FormatHead(head);
+    buffers.reserve(buffers.size() + 2 + content_views_.size());
+
+    auto append = [&buffers](string_view fragment) {
+        if (!fragment.empty())
+            buffers.push_back({const_cast<char*>(fragment.data()), fragment.size()});
+    };
+
+    append(head);
+    append(content_);
+    for (string_view fragment : content_views_) {
+        append(fragment);
+    }
+}
+
+size_t HttpResponse::PullChunk(ContentStream& stream, vector<string_view>& chunk, string& size_line) {
+    chunk.clear();
+    stream(chunk);
+
+    size_t size = 0;
+    for (string_view fragment : chunk) {
+        size += fragment.size();
+    }
+
+    char digits[2 * sizeof(size_t)];
+    const auto [end, error] = to_chars(begin(digits), std::end(digits), size, 16);
+    size_line.assign(digits, end);
+    size_line += "\r\n";
+    return size;
+}
+
+void HttpResponse::AppendNextChunk(vector<iovec>& buffers) {
+    static const string_view kChunkEnd = "\r\n";
+
+    if (!HasMoreChunks())
+        return;
+
+    stream_finished_ = PullChunk(content_stream_, chunk_, chunk_size_line_) == 0;
+    buffers.reserve(buffers.size() + 2 + chunk_.size());
+    if (!close_delimited_)
+        buffers.push_back({chunk_size_line_.data(), chunk_size_line_.size()});
+    if (!stream_finished_) {
+        for (string_view fragment : chunk_) {
+            if (!fragment.empty())
+                buffers.push_back({const_cast<char*>(fragment.data()), fragment.size()});
+        }
+    }
+    if (!close_delimited_)
+        buffers.push_back({const_cast<char*>(kChunkEnd.data()), kChunkEnd.size()});
+}
+
+ostream& operator<<(ostream& output, const HttpResponse& resp) {
+    string head;
+    resp.FormatHead(head);
+    output << head << resp.content_;
+
+    for (string_view fragment : resp.content_views_)
+        output << fragment;
+
+    if (resp.content_stream_) {
+        // A copy, so printing doesn't consume the response
+        HttpResponse::ContentStream stream = resp.content_stream_;
+        vector<string_view> chunk;
+        string size_line;
+        size_t size;
+        do {
+            size = HttpResponse::PullChunk(stream, chunk, size_line);
+            if (!resp.close_delimited_)
+                output << size_line;
+            if (size > 0) {
+                for (string_view fragment : chunk)
+                    output << fragment;
+            }
+            if (!resp.close_delimited_)
+                output << "\r\n";
+        } while (size > 0);
+    }
+
+    return output;
+}
+
+pair<string_view, string_view> SplitBy(string_view what, string_view by) {
+    size_t pos = what.find(by);
+    if (by.size() < what.size() && pos < what.size() - by.size()) {
+        return {what.substr(0, pos), what.substr(pos + by.size())};
+    } else {
+        return {what, {}};
+    }
+}
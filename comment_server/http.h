@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <functional>
+#include <initializer_list>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/uio.h>
+
+using namespace std;
+
+// Query parameters in request order. The first few are stored inline, so typical requests don't allocate.
+class HttpParams {
+public:
+    using Param = pair<string_view, string_view>;
+
+    HttpParams() = default;
+
+    HttpParams(initializer_list<Param> params);
+
+    void Add(string_view name, string_view value);
+
+    optional<string_view> Find(string_view name) const;
+
+    string_view At(string_view name) const;
+
+    const Param* begin() const {
+        return Data();
+    }
+
+    const Param* end() const {
+        return Data() + size_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    static constexpr size_t kInlineCapacity = 8;
+
+    array<Param, kInlineCapacity> inline_;
+    vector<Param> spilled_;
+    size_t size_ = 0;
+
+    const Param* Data() const {
+        return spilled_.empty() ? inline_.data() : spilled_.data();
+    }
+};
+
+// Views into the buffer the request was parsed from; they stay valid until that buffer is fed more data
+struct HttpRequest {
+    string_view method, path, body;
+    HttpParams get_params;
+    bool keep_alive = true;
+    string_view version = "HTTP/1.1";
+};
+
+enum class HttpCode {
+    Ok = 200,
+    NotFound = 404,
+    Found = 302,
+    BadRequest = 400,
+    InternalServerError = 500,
+};
+
+string_view ReasonPhrase(HttpCode code);
+
+ostream& operator<<(ostream& os, const HttpCode& code);
+
+class HttpResponse {
+public:
+    // Produces a streamed body: each call appends the next fragments, and appending nothing (or only
+    // empty fragments) ends the body. Fragments must stay in place until they have been written out,
+    // and a copy of the stream must produce the body from the start independently.
+    using ContentStream = function<void(vector<string_view>& fragments)>;
+
+    explicit HttpResponse(HttpCode code) : code_(code) {}
+
+    HttpResponse& AddHeader(string name, string value) {
+        headers_.emplace_back(make_pair(move(name), move(value)));
+        return *this;
+    }
+
+    HttpResponse& SetContent(string a_content) {
+        content_ = move(a_content);
+        return *this;
+    }
+
+    // Appends a fragment after the owned content without copying it. The viewed bytes must stay
+    // in place until the response has been written out.
+    HttpResponse& AddContentView(string_view fragment) {
+        if (!fragment.empty()) {
+            content_views_.push_back(fragment);
+            content_views_size_ += fragment.size();
+        }
+        return *this;
+    }
+
+    // Sends the body with chunked transfer encoding, pulling it from stream one chunk at a time
+    // instead of holding it whole. The stream replaces any content set so far.
+    HttpResponse& SetContentStream(ContentStream stream) {
+        content_.clear();
+        content_views_.clear();
+        content_views_size_ = 0;
+        content_stream_ = move(stream);
+        return *this;
+    }
+
+    // HTTP/1.0 peers don't understand chunked encoding: a streamed body is then sent as is and
+    // ends when the connection closes
+    HttpResponse& SetCloseDelimited() {
+        close_delimited_ = true;
+        return *this;
+    }
+
+    HttpResponse& SetCode(HttpCode a_code) {
+        code_ = a_code;
+        return *this;
+    }
+
+    size_t ContentLength() const {
+        return content_.size() + content_views_size_;
+    }
+
+    // Formats the status line and headers into head and appends iovecs for head and every content
+    // fragment, ready for writev. The iovecs point into head, this response and the viewed storage.
+    // A streamed body is left out; it follows through AppendNextChunk.
+    void AppendTo(string& head, vector<iovec>& buffers) const;
+
+    bool HasMoreChunks() const {
+        return content_stream_ && !stream_finished_;
+    }
+
+    // Appends iovecs for the next chunk of a streamed body, or for the final empty chunk once the
+    // stream runs dry. A close-delimited body has no chunk framing, so the end appends nothing.
+    // The iovecs of the previous chunk become invalid.
+    void AppendNextChunk(vector<iovec>& buffers);
+
+    friend ostream& operator<<(ostream& output, const HttpResponse& resp);
+
+private:
+    HttpCode code_;
+    vector<pair<string, string>> headers_;
+    string content_;
+    vector<string_view> content_views_;
+    size_t content_views_size_ = 0;
+    ContentStream content_stream_;
+    bool stream_finished_ = false;
+    bool close_delimited_ = false;
+    vector<string_view> chunk_;
+    string chunk_size_line_;
+
+    void FormatHead(string& head) const;
+
+    // Pulls the next fragments into chunk and formats its size line; returns the chunk size
+    static size_t PullChunk(ContentStream& stream, vector<string_view>& chunk, string& size_line);
+};
+
+pair<string_view, string_view> SplitBy(string_view what, string_view by);
+
+template<typename T>
+T FromString(string_view s) {
+    static_assert(is_integral_v<T>);
+
+    T x{};
+    if (auto [end, error] = from_chars(s.data(), s.data() + s.size(), x); error != errc() || end != s.data() + s.size())
+        throw invalid_argument("Not a number: " + string(s));
+    return x;
+}
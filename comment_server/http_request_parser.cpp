@@ -0,0 +1,153 @@
+#include "http_request_parser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace {
+    bool EqualsIgnoreCase(string_view lhs, string_view rhs) {
+        return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin(), [](char a, char b) {
+            return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b));
+        });
+    }
+
+    string_view Trim(string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+            value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t' || value.back() == '\r'))
+            value.remove_suffix(1);
+        return value;
+    }
+
+    void ParseQuery(string_view query, HttpParams& params) {
+        while (!query.empty()) {
+            const size_t end = min(query.find('&'), query.size());
+            const string_view param = query.substr(0, end);
+            const size_t equals = param.find('=');
+
+            if (equals == string_view::npos)
+                params.Add(param, {});
+            else
+                params.Add(param.substr(0, equals), param.substr(equals + 1));
+
+            query.remove_prefix(min(end + 1, query.size()));
+        }
+    }
+
+    string_view NextLine(string_view text, size_t& position) {
+        const size_t line_end = min(text.find('\n', position), text.size());
+        const string_view line = text.substr(position, line_end - position);
+        position = line_end + 1;
+        return Trim(line);
+    }
+}
+
+void HttpRequestParser::Feed(string_view data) {
+    if (offset_ > 0 && offset_ >= buffer_.size() / 2) {
+        buffer_.erase(0, offset_);
+        scan_ -= offset_;
+        if (headers_end_ != 0)
+            headers_end_ -= offset_;
+        offset_ = 0;
+    }
+    buffer_.append(data);
+}
+
+optional<HttpRequest> HttpRequestParser::Next() {
+    if (headers_end_ == 0 && !FindHeadersEnd())
+        return nullopt;
+
+    size_t content_length = 0;
+    HttpRequest request = ParseHeaders(content_length);
+    if (buffer_.size() - headers_end_ < content_length)
+        return nullopt;
+
+    request.body = string_view(buffer_).substr(headers_end_, content_length);
+    offset_ = scan_ = headers_end_ + content_length;
+    headers_end_ = 0;
+    return request;
+}
+
+bool HttpRequestParser::FindHeadersEnd() {
+    scan_ = max(scan_, offset_);
+
+    while (true) {
+        const size_t line_end = buffer_.find('\n', scan_);
+        if (line_end == string::npos) {
+            if (buffer_.size() - offset_ > kMaxHeaderSize)
+                throw invalid_argument("Request headers are too long");
+            return false;
+        }
+
+        const string_view line = string_view(buffer_).substr(scan_, line_end - scan_);
+        const bool blank = scan_ > offset_ && Trim(line).empty();
+        scan_ = line_end + 1;
+
+        if (blank) {
+            headers_end_ = scan_;
+            return true;
+        }
+    }
+}
+
+HttpRequest HttpRequestParser::ParseHeaders(size_t& content_length) const {
+    const string_view headers = string_view(buffer_).substr(offset_, headers_end_ - offset_);
+    size_t position = 0;
+
+    HttpRequest request;
+    const string_view request_line = NextLine(headers, position);
+    const size_t method_end = request_line.find(' ');
+    const size_t target_end = request_line.find(' ', method_end + 1);
+    if (method_end == string_view::npos || target_end == string_view::npos)
+        throw invalid_argument("Malformed request line");
+
+    request.method = request_line.substr(0, method_end);
+    const string_view target = request_line.substr(method_end + 1, target_end - method_end - 1);
+    request.version = request_line.substr(target_end + 1);
+    request.keep_alive = request.version != "HTTP/1.0";
+
+    const size_t query_start = target.find('?');
+    request.path = target.substr(0, query_start);
+    if (query_start != string_view::npos)
+        ParseQuery(target.substr(query_start + 1), request.get_params);
+
+    content_length = 0;
+    bool has_content_length = false;
+    bool has_transfer_encoding = false;
+    while (position < headers.size()) {
+        const string_view header = NextLine(headers, position);
+        if (header.empty())
+            continue;
+
+        const size_t colon = header.find(':');
+        if (colon == string_view::npos)
+            throw invalid_argument("Malformed header");
+
+        const string_view name = header.substr(0, colon);
+        const string_view value = Trim(header.substr(colon + 1));
+        if (EqualsIgnoreCase(name, "Content-Length")) {
+            if (has_content_length)
+                throw invalid_argument("Repeated Content-Length");
+            has_content_length = true;
+            content_length = FromString<size_t>(value);
+            if (content_length > kMaxBodySize)
+                throw invalid_argument("Request body is too long");
+        } else if (EqualsIgnoreCase(name, "Transfer-Encoding")) {
+            // Chunked request bodies are not supported; skipping one would parse its chunks as the
+            // next pipelined request, which lets a request be smuggled past a proxy
+            if (!EqualsIgnoreCase(value, "identity"))
+                throw invalid_argument("Unsupported transfer encoding");
+            has_transfer_encoding = true;
+        } else if (EqualsIgnoreCase(name, "Connection")) {
+            if (EqualsIgnoreCase(value, "close"))
+                request.keep_alive = false;
+            else if (EqualsIgnoreCase(value, "keep-alive"))
+                request.keep_alive = true;
+        }
+    }
+
+    if (has_content_length && has_transfer_encoding)
+        throw invalid_argument("Both Content-Length and Transfer-Encoding");
+
+    return request;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "http.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Accumulates bytes from a connection and cuts them into requests. Several pipelined requests
+// may arrive in one Feed, and one request may be split across many; a partial request is not
+// rescanned from its start when more bytes come. Returned requests view the internal buffer,
+// so they must be used before the next Feed.
+class HttpRequestParser {
+public:
+    void Feed(string_view data);
+
+    // Returns nullopt until a whole request is buffered; throws invalid_argument on malformed input
+    optional<HttpRequest> Next();
+
+    size_t BufferedSize() const {
+        return buffer_.size() - offset_;
+    }
+
+private:
+    static constexpr size_t kMaxHeaderSize = 64 * 1024;
+    static constexpr size_t kMaxBodySize = 16 * 1024 * 1024;
+
+    string buffer_;
+    size_t offset_ = 0;
+    // Where the search for the blank line ending the headers resumes, and where it was found
+    size_t scan_ = 0;
+    size_t headers_end_ = 0;
+
+    bool FindHeadersEnd();
+
+    HttpRequest ParseHeaders(size_t& content_length) const;
+};
@@ -1,5 +1,21 @@
+#include "alloc_counter.h"
+#include "comment_arena.h"
+#include "comment_log.h"
+#include "comment_server.h"
+#include "epoll_server.h"
+#include "http.h"
+#include "http_request_parser.h"
+#include "profile.h"
+#include "route_table.h"
 #include "test_runner.h"
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <cstdlib>
+#include <future>
 #include <vector>
 #include <string>
 #include <iostream>
@@ -7,183 +23,19 @@
 #include <utility>
 #include <map>
 #include <optional>
+#include <thread>
 #include <unordered_set>
 
-using namespace std;
-
-struct HttpRequest {
-    string method, path, body;
-    map<string, string> get_params;
-};
-
-enum class HttpCode {
-    Ok = 200,
-    NotFound = 404,
-    Found = 302,
-};
-
-ostream& operator<<(ostream& os, const HttpCode& code) {
-    os << static_cast<int>(code) << " ";
-
-    switch (code) {
-        case HttpCode::Ok:
-            os << "OK";
-            break;
-
-        case HttpCode::NotFound:
-            os << "Not found";
-            break;
-
-        case HttpCode::Found:
-            os << "Found";
-            break;
-    }
-
-    return os;
-}
-
-class HttpResponse {
-public:
-    explicit HttpResponse(HttpCode code) : code_(code) {}
-
-    HttpResponse& AddHeader(string name, string value) {
-        headers_.emplace_back(make_pair(move(name), move(value)));
-        return *this;
-    }
-
-    HttpResponse& SetContent(string a_content) {
-        content_ = move(a_content);
-        return *this;
-    }
-
-    HttpResponse& SetCode(HttpCode a_code) {
-        code_ = a_code;
-        return *this;
-    }
-
-    friend ostream& operator<<(ostream& output, const HttpResponse& resp) {
-        output << "HTTP/1.1 " << resp.code_ << "\n";
-
-        for (const auto& header : resp.headers_)
-            output << header.first << ": " << header.second << "\n";
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-        if (!resp.content_.empty()) {
-            output << "Content-Length: " << resp.content_.size() << "\n\n";
-            output << resp.content_;
-        }
-        else {
-            output << "\n";
-        }
-
-        return output;
-    }
-
-private:
-    HttpCode code_;
-    vector<pair<string, string>> headers_;
-    string content_;
-};
-
-pair<string, string> SplitBy(const string& what, const string& by) {
-    size_t pos = what.find(by);
-    if (by.size() < what.size() && pos < what.size() - by.size()) {
-        return {what.substr(0, pos), what.substr(pos + by.size())};
-    } else {
-        return {what, {}};
-    }
-}
-
-template<typename T>
-T FromString(const string& s) {
-    T x;
-    istringstream is(s);
-    is >> x;
-    return x;
-}
-
-pair<size_t, string> ParseIdAndContent(const string& body) {
-    auto [id_string, content] = SplitBy(body, " ");
-    return {FromString<size_t>(id_string), content};
-}
-
-struct LastCommentInfo {
-    size_t user_id, consecutive_count;
-};
-
-class CommentServer {
-private:
-    vector<vector<string>> comments_;
-    std::optional<LastCommentInfo> last_comment;
-    unordered_set<size_t> banned_users;
-
-public:
-    HttpResponse ServeRequest(const HttpRequest& req) {
-        HttpResponse res(HttpCode::NotFound);
-
-        if (req.method == "POST") {
-            if (req.path == "/add_user") {
-                comments_.emplace_back();
-                auto response = to_string(comments_.size() - 1);
-
-                res.SetCode(HttpCode::Ok);
-                res.SetContent(response);
-            }
-            else if (req.path == "/add_comment") {
-                auto [user_id, comment] = ParseIdAndContent(req.body);
-
-                if (!last_comment || last_comment->user_id != user_id) {
-                    last_comment = LastCommentInfo {user_id, 1};
-                }
-                else if (++last_comment->consecutive_count > 3) {
-                    banned_users.insert(user_id);
-                }
-
-                if (banned_users.count(user_id) == 0) {
-                    comments_[user_id].push_back(string(comment));
-
-                    res.SetCode(HttpCode::Ok);
-                }
-                else {
-                    res.SetCode(HttpCode::Found);
-                    res.AddHeader("Location", "/captcha");
-                }
-            }
-            else if (req.path == "/checkcaptcha") {
-                if (auto [id, response] = ParseIdAndContent(req.body); response == "42") {
-                    banned_users.erase(id);
-
-                    if (last_comment && last_comment->user_id == id) {
-                        last_comment.reset();
-                    }
-
-                    res.SetCode(HttpCode::Ok);
-                }
-                else {
-                    res.SetCode(HttpCode::Found);
-                    res.AddHeader("Location", "/captcha");
-                }
-            }
-        }
-        else if (req.method == "GET") {
-            if (req.path == "/user_comments") {
-                auto user_id = FromString<size_t>(req.get_params.at("user_id"));
-                string response;
-                for (const string& c : comments_[user_id]) {
-                    response += c + '\n';
-                }
-
-                res.SetCode(HttpCode::Ok);
-                res.SetContent(response);
-            }
-            else if (req.path == "/captcha") {
-                res.SetCode(HttpCode::Ok);
-                res.SetContent("What's the answer for The Ultimate Question of Life, the Universe, and Everything?");
-            }
-        }
-
-        return res;
-    }
-};
+using namespace std;
 
 struct HttpHeader {
     string name, value;
@@ -203,9 +55,16 @@ struct ParsedResponse {
     string content;
 };
 
+istream& ReadLine(istream& input, string& line) {
+    getline(input, line);
+    if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    return input;
+}
+
 istream& operator >>(istream& input, ParsedResponse& r) {
     string line;
-    getline(input, line);
+    ReadLine(input, line);
 
     {
         istringstream code_input(line);
@@ -213,20 +72,43 @@ istream& operator >>(istream& input, ParsedResponse& r) {
         code_input >> dummy >> r.code;
     }
 
-    size_t content_length = 0;
+    optional<size_t> content_length;
+    bool chunked = false;
 
     r.headers.clear();
-    while (getline(input, line) && !line.empty()) {
+    while (ReadLine(input, line) && !line.empty()) {
         if (auto [name, value] = SplitBy(line, ": "); name == "Content-Length") {
-            istringstream length_input(value);
-            length_input >> content_length;
+            istringstream length_input{string(value)};
+            length_input >> content_length.emplace();
+        } else if (name == "Transfer-Encoding" && value == "chunked") {
+            chunked = true;
         } else {
-            r.headers.push_back( {std::move(name), std::move(value)});
+            r.headers.push_back({string(name), string(value)});
         }
     }
 
-    r.content.resize(content_length);
-    input.read(r.content.data(), r.content.size());
+    if (content_length) {
+        r.content.resize(*content_length);
+        input.read(r.content.data(), r.content.size());
+        return input;
+    }
+
+    // Neither length nor chunks: the body runs until the connection closes
+    if (!chunked) {
+        r.content.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+        return input;
+    }
+
+    r.content.clear();
+    while (ReadLine(input, line)) {
+        const size_t chunk_size = stoul(line, nullptr, 16);
+        const size_t chunk_start = r.content.size();
+        r.content.resize(chunk_start + chunk_size);
+        input.read(r.content.data() + chunk_start, chunk_size);
+        ReadLine(input, line);
+        if (chunk_size == 0)
+            break;
+    }
     return input;
 }
 
@@ -288,7 +170,1178 @@ void TestServer() {
     Test(cs, {"POST", "/add_uesr"}, not_found);
 }
 
+string Describe(const HttpRequest& request) {
+    string description = string(request.method) + " " + string(request.path);
+    for (const auto& [name, value] : request.get_params) {
+        description += " " + string(name) + "=" + string(value);
+    }
+    return description + " [" + string(request.body) + "]" + (request.keep_alive ? "" : " close");
+}
+
+void TestRequestParser() {
+    const string pipelined =
+            "POST /add_comment HTTP/1.1\r\nHost: localhost\r\nContent-Length: 7\r\n\r\n0 Hello"
+            "GET /user_comments?user_id=0&verbose HTTP/1.1\r\n\r\n"
+            "GET /captcha HTTP/1.0\n\n"
+            "GET /captcha HTTP/1.1\r\nconnection: Close\r\n\r\n";
+    const vector<string> expected = {
+        "POST /add_comment [0 Hello]",
+        "GET /user_comments user_id=0 verbose= []",
+        "GET /captcha [] close",
+        "GET /captcha [] close",
+    };
+
+    HttpRequestParser parser;
+    vector<string> requests;
+    for (char c : pipelined) {
+        parser.Feed({&c, 1});
+        while (auto request = parser.Next()) {
+            requests.push_back(Describe(*request));
+        }
+    }
+
+    ASSERT_EQUAL(requests, expected);
+    ASSERT_EQUAL(parser.BufferedSize(), 0u);
+
+    HttpParams many;
+    for (int i = 0; i < 20; ++i) {
+        many.Add("p", "v");
+    }
+    many.Add("last", "20");
+    ASSERT_EQUAL(many.Size(), 21u);
+    ASSERT_EQUAL(many.At("last"), "20");
+    ASSERT(!many.Find("missing"));
+
+    HttpRequestParser whole;
+    whole.Feed(pipelined);
+    requests.clear();
+    while (auto request = whole.Next()) {
+        requests.push_back(Describe(*request));
+    }
+    ASSERT_EQUAL(requests, expected);
+
+    for (const string bad : {"GARBAGE\r\n\r\n", "POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+                             "GET / HTTP/1.1\r\nno colon\r\n\r\n",
+                             "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n",
+                             "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",
+                             "POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: identity\r\n\r\nhello",
+                             "POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 0\r\n\r\nhello"}) {
+        HttpRequestParser bad_parser;
+        bad_parser.Feed(bad);
+        try {
+            bad_parser.Next();
+            ASSERT(false);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+class LoopbackClient {
+public:
+    explicit LoopbackClient(uint16_t port) : fd_(socket(AF_INET, SOCK_STREAM, 0)) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd_ < 0 || connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+            throw runtime_error("Unable to connect to the test server");
+
+        const int enable = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    }
+
+    ~LoopbackClient() {
+        close(fd_);
+    }
+
+    void Send(const string& data) {
+        for (size_t sent = 0; sent < data.size();) {
+            const ssize_t size = send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (size <= 0)
+                throw runtime_error("Unable to send a request");
+            sent += size;
+        }
+    }
+
+    vector<ParsedResponse> Receive(size_t count) {
+        vector<ParsedResponse> responses;
+        while (responses.size() < count) {
+            size_t response_size = CompleteResponseSize();
+            while (response_size == 0) {
+                char chunk[64 * 1024];
+                const ssize_t size = recv(fd_, chunk, sizeof(chunk), 0);
+                if (size <= 0)
+                    return responses;
+                buffer_.erase(0, offset_);
+                offset_ = 0;
+                buffer_.append(chunk, size);
+                response_size = CompleteResponseSize();
+            }
+
+            istringstream input(buffer_.substr(offset_, response_size));
+            input >> responses.emplace_back();
+            offset_ += response_size;
+        }
+        return responses;
+    }
+
+    // For a response whose body ends when the server closes the connection
+    ParsedResponse ReceiveUntilClosed() {
+        char chunk[64 * 1024];
+        ssize_t size;
+        while ((size = recv(fd_, chunk, sizeof(chunk), 0)) > 0) {
+            buffer_.append(chunk, size);
+        }
+
+        istringstream input(buffer_.substr(offset_));
+        offset_ = buffer_.size();
+        ParsedResponse response;
+        input >> response;
+        return response;
+    }
+
+    bool PeerClosed() {
+        char c;
+        return offset_ == buffer_.size() && recv(fd_, &c, 1, 0) == 0;
+    }
+
+private:
+    int fd_;
+    string buffer_;
+    size_t offset_ = 0;
+
+    size_t CompleteResponseSize() const {
+        const size_t headers_end = buffer_.find("\r\n\r\n", offset_);
+        if (headers_end == string::npos)
+            return 0;
+
+        const size_t encoding_start = buffer_.find("Transfer-Encoding: chunked", offset_);
+        if (encoding_start < headers_end)
+            return CompleteChunkedResponseSize(headers_end + 4);
+
+        const size_t length_start = buffer_.find("Content-Length: ", offset_);
+        const size_t content_length = strtoul(buffer_.c_str() + length_start + 16, nullptr, 10);
+        const size_t size = headers_end + 4 + content_length - offset_;
+        return buffer_.size() - offset_ >= size ? size : 0;
+    }
+
+    size_t CompleteChunkedResponseSize(size_t chunk_start) const {
+        while (true) {
+            const size_t size_line_end = buffer_.find("\r\n", chunk_start);
+            if (size_line_end == string::npos)
+                return 0;
+
+            const size_t chunk_size = strtoul(buffer_.c_str() + chunk_start, nullptr, 16);
+            chunk_start = size_line_end + 2 + chunk_size + 2;
+            if (chunk_start > buffer_.size())
+                return 0;
+            if (chunk_size == 0)
+                return chunk_start - offset_;
+        }
+    }
+};
+
+string MakeRequest(const string& method, const string& target, const string& body = {}) {
+    string request = method + " " + target + " HTTP/1.1\r\nHost: localhost\r\n";
+    if (!body.empty())
+        request += "Content-Length: " + to_string(body.size()) + "\r\n";
+    return request + "\r\n" + body;
+}
+
+struct StreamRequest {
+    string method, path, body;
+    map<string, string> get_params;
+};
+
+istream& operator >>(istream& input, StreamRequest& r) {
+    string line;
+    if (!ReadLine(input, line))
+        return input;
+
+    string target;
+    {
+        istringstream request_line(line);
+        request_line >> r.method >> target;
+    }
+
+    auto [path, query] = SplitBy(target, "?");
+    r.path = string(path);
+    r.get_params.clear();
+    istringstream query_input{string(query)};
+    string param;
+    while (getline(query_input, param, '&')) {
+        auto [name, value] = SplitBy(param, "=");
+        r.get_params[string(name)] = string(value);
+    }
+
+    size_t content_length = 0;
+    while (ReadLine(input, line) && !line.empty()) {
+        if (auto [name, value] = SplitBy(line, ": "); name == "Content-Length") {
+            istringstream length_input{string(value)};
+            length_input >> content_length;
+        }
+    }
+
+    r.body.resize(content_length);
+    input.read(r.body.data(), r.body.size());
+    return input;
+}
+
+void ReportThroughput(const string& name, size_t bytes, chrono::steady_clock::duration elapsed) {
+    const auto microseconds = max<int64_t>(chrono::duration_cast<chrono::microseconds>(elapsed).count(), 1);
+    cerr << name << ": " << bytes / microseconds << " MB/s" << endl;
+}
+
+void TestRequestParserSpeed() {
+    string corpus;
+    for (int i = 0; i < 20000; ++i) {
+        const string user_id = to_string(i % 100);
+        corpus += MakeRequest("POST", "/add_comment", user_id + " Comment number " + to_string(i));
+        corpus += MakeRequest("GET", "/user_comments?user_id=" + user_id);
+        corpus += MakeRequest("GET", "/captcha");
+    }
+    const size_t request_count = 60000;
+    const size_t read_size = 4096;
+
+    size_t stream_count = 0;
+    size_t stream_body_bytes = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        istringstream input(corpus);
+        StreamRequest request;
+        while (input >> request) {
+            ++stream_count;
+            stream_body_bytes += request.body.size();
+        }
+    }
+    ReportThroughput("Stream-based request parsing", corpus.size(), chrono::steady_clock::now() - start);
+
+    size_t parser_count = 0;
+    size_t parser_body_bytes = 0;
+    start = chrono::steady_clock::now();
+    {
+        HttpRequestParser parser;
+        for (size_t offset = 0; offset < corpus.size(); offset += read_size) {
+            parser.Feed(string_view(corpus).substr(offset, read_size));
+            while (auto request = parser.Next()) {
+                ++parser_count;
+                parser_body_bytes += request->body.size();
+            }
+        }
+    }
+    ReportThroughput("Incremental view-based parsing in 4 KiB reads", corpus.size(),
+                     chrono::steady_clock::now() - start);
+
+    ASSERT_EQUAL(stream_count, request_count);
+    ASSERT_EQUAL(parser_count, request_count);
+    ASSERT_EQUAL(parser_body_bytes, stream_body_bytes);
+}
+
+// Runs server.Run on another thread and stops it when the scope ends, even if an assertion fails
+template <typename Server>
+class BackgroundServer {
+public:
+    explicit BackgroundServer(Server& server) : server_(server), running_(async(launch::async, [&server] {
+        server.Run();
+    })) {
+    }
+
+    ~BackgroundServer() {
+        server_.Stop();
+        running_.wait();
+    }
+
+private:
+    Server& server_;
+    future<void> running_;
+};
+
+void TestEpollServer() {
+    CommentServer comments;
+    EpollServer server([&comments](const HttpRequest& request) {
+        return comments.ServeRequest(request);
+    });
+    BackgroundServer background(server);
+
+    {
+        LoopbackClient client(server.Port());
+        client.Send(MakeRequest("POST", "/add_user") + MakeRequest("POST", "/add_user")
+                    + MakeRequest("POST", "/add_comment", "1 Hi") + MakeRequest("POST", "/add_comment", "0 Hello"));
+        const auto created = client.Receive(4);
+        ASSERT_EQUAL(created.size(), 4u);
+        ASSERT_EQUAL(created[0].content, "0");
+        ASSERT_EQUAL(created[1].content, "1");
+        ASSERT_EQUAL(created[2].code, 200);
+
+        const string split = MakeRequest("POST", "/add_comment", "1 Split across packets");
+        client.Send(split.substr(0, 10));
+        this_thread::sleep_for(chrono::milliseconds(5));
+        client.Send(split.substr(10));
+        ASSERT_EQUAL(client.Receive(1).at(0).code, 200);
+
+        client.Send(MakeRequest("GET", "/user_comments?user_id=1"));
+        ASSERT_EQUAL(client.Receive(1).at(0).content, "Hi\nSplit across packets\n");
+
+        client.Send(MakeRequest("GET", "/user_comments"));
+        ASSERT_EQUAL(client.Receive(1).at(0).code, 400);
+
+        string expected_listing;
+        string batch;
+        for (int i = 0; i < 10000; ++i) {
+            const string comment = "Comment number " + to_string(i) + " from a prolific user";
+            expected_listing += comment + "\n";
+            batch += MakeRequest("POST", "/add_comment", "0 " + comment) + MakeRequest("POST", "/add_comment", "1 Hi");
+        }
+        client.Send(batch);
+        ASSERT_EQUAL(client.Receive(20000).size(), 20000u);
+
+        client.Send(MakeRequest("GET", "/user_comments?user_id=0") + MakeRequest("GET", "/captcha"));
+        const auto listing = client.Receive(2);
+        ASSERT_EQUAL(listing.at(0).content, "Hello\n" + expected_listing);
+        ASSERT_EQUAL(listing.at(1).code, 200);
+    }
+
+    {
+        LoopbackClient client(server.Port());
+        client.Send("GET /captcha HTTP/1.1\r\nConnection: close\r\n\r\n" + MakeRequest("GET", "/captcha"));
+        const auto responses = client.Receive(2);
+        ASSERT_EQUAL(responses.size(), 1u);
+        ASSERT_EQUAL(responses[0].headers, (vector<HttpHeader>{{"Connection", "close"}}));
+        ASSERT(client.PeerClosed());
+    }
+
+    {
+        // Chunked encoding is not for HTTP/1.0 clients: the listing ends with the connection instead
+        LoopbackClient client(server.Port());
+        client.Send("GET /user_comments?user_id=1 HTTP/1.0\r\n\r\n");
+        const ParsedResponse listing = client.ReceiveUntilClosed();
+        ASSERT_EQUAL(listing.code, 200);
+        ASSERT_EQUAL(listing.headers, (vector<HttpHeader>{{"Connection", "close"}}));
+        string expected = "Hi\nSplit across packets\n";
+        for (int i = 0; i < 10000; ++i) {
+            expected += "Hi\n";
+        }
+        ASSERT_EQUAL(listing.content, expected);
+    }
+
+    {
+        LoopbackClient client(server.Port());
+        client.Send("NONSENSE\r\n\r\n");
+        ASSERT_EQUAL(client.Receive(1).at(0).code, 400);
+        ASSERT(client.PeerClosed());
+    }
+}
+
+void TestEpollServerHandlerErrors() {
+    EpollServer server([](const HttpRequest& request) -> HttpResponse {
+        if (request.path == "/bad_number")
+            FromString<int>("forty-two");
+        if (request.path == "/missing_parameter")
+            request.get_params.At("user_id");
+        if (request.path == "/broken")
+            throw runtime_error("Unable to write to a file");
+        return HttpResponse(HttpCode::Ok);
+    });
+    BackgroundServer background(server);
+
+    // The client's fault: 400 and the connection goes on
+    {
+        LoopbackClient client(server.Port());
+        client.Send(MakeRequest("GET", "/bad_number") + MakeRequest("GET", "/missing_parameter")
+                    + MakeRequest("GET", "/fine"));
+        const auto responses = client.Receive(3);
+        ASSERT_EQUAL(responses.size(), 3u);
+        ASSERT_EQUAL(responses[0].code, 400);
+        ASSERT_EQUAL(responses[1].code, 400);
+        ASSERT_EQUAL(responses[2].code, 200);
+    }
+
+    // The server's fault: 500 and the connection is closed
+    {
+        LoopbackClient client(server.Port());
+        client.Send(MakeRequest("GET", "/broken") + MakeRequest("GET", "/fine"));
+        const auto responses = client.Receive(2);
+        ASSERT_EQUAL(responses.size(), 1u);
+        ASSERT_EQUAL(responses[0].code, 500);
+        ASSERT_EQUAL(responses[0].headers, (vector<HttpHeader>{{"Connection", "close"}}));
+        ASSERT(client.PeerClosed());
+    }
+}
+
+void TestEpollServerBackPressure() {
+    CommentServer comments;
+    EpollServer server([&comments](const HttpRequest& request) {
+        return comments.ServeRequest(request);
+    });
+    BackgroundServer background(server);
+
+    // Far more than the socket buffers hold: the server has to stop reading while the client
+    // doesn't read, and pick up the rest of the input once it does
+    const size_t request_count = 200000;
+    string batch;
+    for (size_t i = 0; i < request_count; ++i) {
+        batch += MakeRequest("GET", "/captcha");
+    }
+
+    LoopbackClient greedy(server.Port());
+    auto sender = async(launch::async, [&greedy, &batch] {
+        greedy.Send(batch);
+    });
+    this_thread::sleep_for(chrono::milliseconds(100));
+
+    // The loop stays responsive to other connections meanwhile
+    LoopbackClient other(server.Port());
+    other.Send(MakeRequest("POST", "/add_user"));
+    ASSERT_EQUAL(other.Receive(1).at(0).content, "0");
+
+    const auto responses = greedy.Receive(request_count);
+    sender.get();
+    ASSERT_EQUAL(responses.size(), request_count);
+    ASSERT_EQUAL(responses.back().code, 200);
+}
+
+void ReportLatencies(const string& name, vector<chrono::nanoseconds> latencies, chrono::nanoseconds elapsed) {
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](size_t p) {
+        return chrono::duration_cast<chrono::microseconds>(latencies[(latencies.size() - 1) * p / 100]).count();
+    };
+
+    cerr << name << ": " << latencies.size() * 1'000'000'000LL / max<int64_t>(elapsed.count(), 1) << " req/s"
+         << ", p50 " << percentile(50) << " us, p99 " << percentile(99) << " us" << endl;
+}
+
+// Each client keeps one connection and sends make_request(client, index) in batches of depth;
+// every request in a batch is charged the whole batch's round trip
+template <typename MakeRequest>
+void RunLoad(const string& name, uint16_t port, size_t client_count, size_t requests_per_client, size_t depth,
+             MakeRequest make_request) {
+    vector<future<vector<chrono::nanoseconds>>> clients;
+    const auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < client_count; ++i) {
+        clients.push_back(async(launch::async, [=] {
+            LoopbackClient client(port);
+            vector<chrono::nanoseconds> latencies;
+            for (size_t sent = 0; sent < requests_per_client; sent += depth) {
+                string batch;
+                for (size_t j = 0; j < depth; ++j) {
+                    batch += make_request(i, sent + j);
+                }
+
+                const auto request_start = chrono::steady_clock::now();
+                client.Send(batch);
+                const auto responses = client.Receive(depth);
+                const auto latency = chrono::steady_clock::now() - request_start;
+                for (const auto& response : responses) {
+                    ASSERT(response.code == 200 || response.code == 302);
+                    latencies.push_back(latency);
+                }
+            }
+            return latencies;
+        }));
+    }
+
+    vector<chrono::nanoseconds> latencies;
+    for (auto& client : clients) {
+        auto client_latencies = client.get();
+        latencies.insert(latencies.end(), client_latencies.begin(), client_latencies.end());
+    }
+    const auto elapsed = chrono::steady_clock::now() - start;
+
+    ASSERT_EQUAL(latencies.size(), client_count * requests_per_client);
+    ReportLatencies(name, move(latencies), elapsed);
+}
+
+void TestEpollServerLoad() {
+    CommentServer comments;
+    EpollServer server([&comments](const HttpRequest& request) {
+        return comments.ServeRequest(request);
+    });
+    BackgroundServer background(server);
+
+    const size_t client_count = 4;
+    for (size_t depth : {1, 16}) {
+        RunLoad(to_string(client_count) + " keep-alive clients, pipeline depth " + to_string(depth),
+                server.Port(), client_count, 2000, depth, [](size_t, size_t) {
+                    return MakeRequest("GET", "/captcha");
+                });
+    }
+}
+
+void TestConcurrentCommentServer() {
+    CommentServer comments;
+    const size_t thread_count = 4;
+    const size_t comments_per_thread = 500;
+
+    vector<future<size_t>> writers;
+    for (size_t t = 0; t < thread_count; ++t) {
+        writers.push_back(async(launch::async, [&comments] {
+            stringstream created;
+            created << comments.ServeRequest({"POST", "/add_user"});
+            ParsedResponse user;
+            created >> user;
+
+            const string id = user.content;
+            for (size_t i = 0; i < comments_per_thread;) {
+                const string body = id + " comment " + to_string(i);
+                stringstream output;
+                output << comments.ServeRequest({"POST", "/add_comment", body});
+                ParsedResponse response;
+                output >> response;
+
+                if (response.code == 200) {
+                    ++i;
+                } else {
+                    const string answer = id + " 42";
+                    comments.ServeRequest({"POST", "/checkcaptcha", answer});
+                }
+            }
+            return FromString<size_t>(id);
+        }));
+    }
+
+    set<size_t> ids;
+    for (auto& writer : writers) {
+        ids.insert(writer.get());
+    }
+    ASSERT_EQUAL(ids, (set<size_t>{0, 1, 2, 3}));
+
+    for (size_t id : ids) {
+        stringstream output;
+        output << comments.ServeRequest({"GET", "/user_comments", "", {{"user_id", to_string(id)}}});
+        ParsedResponse listing;
+        output >> listing;
+
+        string expected;
+        for (size_t i = 0; i < comments_per_thread; ++i) {
+            expected += "comment " + to_string(i) + "\n";
+        }
+        ASSERT_EQUAL(listing.content, expected);
+    }
+
+    comments.ServeRequest({"POST", "/add_user"});
+    vector<future<size_t>> spammers;
+    for (size_t t = 0; t < thread_count; ++t) {
+        spammers.push_back(async(launch::async, [&comments] {
+            size_t accepted = 0;
+            for (int i = 0; i < 200; ++i) {
+                stringstream output;
+                output << comments.ServeRequest({"POST", "/add_comment", "4 Buy my goods"});
+                ParsedResponse response;
+                output >> response;
+                accepted += response.code == 200;
+            }
+            return accepted;
+        }));
+    }
+
+    size_t accepted = 0;
+    for (auto& spammer : spammers) {
+        accepted += spammer.get();
+    }
+    ASSERT_EQUAL(accepted, 3u);
+}
+
+void TestWorkerThreadScaling() {
+    for (size_t thread_count : {1, 2, 4}) {
+        CommentServer comments;
+        EpollServer server([&comments](const HttpRequest& request) {
+            return comments.ServeRequest(request);
+        }, "127.0.0.1", 0, thread_count);
+        BackgroundServer background(server);
+
+        const size_t client_count = 8;
+        for (size_t i = 0; i < client_count; ++i) {
+            LoopbackClient client(server.Port());
+            client.Send(MakeRequest("POST", "/add_user"));
+            client.Receive(1);
+        }
+
+        RunLoad(to_string(thread_count) + " worker threads, " + to_string(client_count) + " clients",
+                server.Port(), client_count, 1000, 1, [](size_t client, size_t index) {
+                    if (index % 2 == 0)
+                        return MakeRequest("POST", "/add_comment", to_string(client) + " comment " + to_string(index));
+                    return MakeRequest("GET", "/captcha");
+                });
+    }
+}
+
+void TestCommentListingSpeed() {
+    CommentServer comments;
+    comments.ServeRequest({"POST", "/add_user"});
+    comments.ServeRequest({"POST", "/add_user"});
+    vector<string> stored;
+    for (int i = 0; i < 10000; ++i) {
+        stored.push_back("Comment number " + to_string(i) + " from a prolific user");
+        const string body = "0 " + stored.back();
+        comments.ServeRequest({"POST", "/add_comment", body});
+        comments.ServeRequest({"POST", "/add_comment", "1 Filler"});
+    }
+    const HttpRequest listing_request{"GET", "/user_comments", "", {{"user_id", "0"}}};
+
+    string expected;
+    for (const string& c : stored) {
+        expected += c + '\n';
+    }
+    {
+        stringstream output;
+        output << comments.ServeRequest(listing_request);
+        ParsedResponse listing;
+        output >> listing;
+        ASSERT_EQUAL(listing.content, expected);
+    }
+
+    const int null_fd = open("/dev/null", O_WRONLY);
+    ASSERT(null_fd >= 0);
+    const int repetitions = 100;
+
+    size_t concatenated_bytes = 0;
+    {
+        LOG_DURATION("100 listings of 10k comments, concatenated and streamed");
+        for (int i = 0; i < repetitions; ++i) {
+            string response;
+            for (const string& c : stored) {
+                response += c + '\n';
+            }
+
+            ostringstream output;
+            output << HttpResponse(HttpCode::Ok).SetContent(move(response));
+            const string serialized = output.str();
+            concatenated_bytes += write(null_fd, serialized.data(), serialized.size());
+        }
+    }
+
+    size_t chunked_bytes = 0;
+    size_t max_buffers = 0;
+    {
+        LOG_DURATION("100 listings of 10k comments, pulled in chunks and gathered with writev");
+        for (int i = 0; i < repetitions; ++i) {
+            HttpResponse response = comments.ServeRequest(listing_request);
+            string head;
+            vector<iovec> buffers;
+            response.AppendTo(head, buffers);
+            do {
+                chunked_bytes += writev(null_fd, buffers.data(), buffers.size());
+                max_buffers = max(max_buffers, buffers.size());
+                buffers.clear();
+                response.AppendNextChunk(buffers);
+            } while (!buffers.empty());
+        }
+    }
+
+    close(null_fd);
+    ASSERT(chunked_bytes > concatenated_bytes);
+    // Chunk size line, 128 comments and the closing CRLF: bounded however long the history is
+    ASSERT(max_buffers <= 130);
+}
+
+void TestPaginatedComments() {
+    CommentServer cs;
+    cs.ServeRequest({"POST", "/add_user"});
+    cs.ServeRequest({"POST", "/add_user"});
+    for (int i = 0; i < 5; ++i) {
+        const string body = "0 c" + to_string(i);
+        cs.ServeRequest({"POST", "/add_comment", body});
+        cs.ServeRequest({"POST", "/add_comment", "1 filler"});
+    }
+
+    Test(cs, {"GET", "/user_comments", "", {{"user_id", "0"}, {"offset", "1"}, {"limit", "2"}}},
+         {200, {{"X-Next-Offset", "3"}}, "c1\nc2\n"});
+    Test(cs, {"GET", "/user_comments", "", {{"user_id", "0"}, {"offset", "3"}}}, {200, {}, "c3\nc4\n"});
+    Test(cs, {"GET", "/user_comments", "", {{"user_id", "0"}, {"limit", "0"}}},
+         {200, {{"X-Next-Offset", "0"}}, ""});
+    Test(cs, {"GET", "/user_comments", "", {{"user_id", "0"}, {"offset", "10"}}}, {200, {}, ""});
+
+    try {
+        cs.ServeRequest({"GET", "/user_comments", "", {{"user_id", "0"}, {"limit", "many"}}});
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+
+    // A page is a snapshot: comments added while it streams belong to the next one
+    HttpResponse page = cs.ServeRequest({"GET", "/user_comments", "", {{"user_id", "0"}}});
+    cs.ServeRequest({"POST", "/add_comment", "0 late"});
+    stringstream output;
+    output << page;
+    ParsedResponse parsed;
+    output >> parsed;
+    ASSERT_EQUAL(parsed.content, "c0\nc1\nc2\nc3\nc4\n");
+}
+
+void TestStreamedCommentsOverEpoll() {
+    CommentServer comments;
+    EpollServer server([&comments](const HttpRequest& request) {
+        return comments.ServeRequest(request);
+    });
+    BackgroundServer background(server);
+
+    LoopbackClient client(server.Port());
+    client.Send(MakeRequest("POST", "/add_user") + MakeRequest("POST", "/add_user"));
+    client.Receive(2);
+
+    string history;
+    string writes;
+    for (int i = 0; i < 1000; ++i) {
+        const string comment = "comment " + to_string(i);
+        history += comment + '\n';
+        writes += MakeRequest("POST", "/add_comment", "0 " + comment);
+        writes += MakeRequest("POST", "/add_comment", "1 filler");
+    }
+    client.Send(writes);
+    client.Receive(2000);
+
+    // The streamed listing must not let the pipelined response behind it jump ahead
+    client.Send(MakeRequest("GET", "/user_comments?user_id=0") + MakeRequest("GET", "/captcha"));
+    const auto responses = client.Receive(2);
+    ASSERT_EQUAL(responses.size(), 2u);
+    ASSERT_EQUAL(responses[0].content, history);
+    ASSERT_EQUAL(responses[1].code, 200);
+
+    string paged;
+    size_t pages = 0;
+    for (optional<string> offset = "0"; offset; ++pages) {
+        client.Send(MakeRequest("GET", "/user_comments?user_id=0&limit=300&offset=" + *offset));
+        const ParsedResponse page = client.Receive(1).at(0);
+        paged += page.content;
+
+        offset.reset();
+        for (const auto& header : page.headers) {
+            if (header.name == "X-Next-Offset")
+                offset = header.value;
+        }
+    }
+    ASSERT_EQUAL(pages, 4u);
+    ASSERT_EQUAL(paged, history);
+}
+
+void TestCommentArena() {
+    CommentArena arena;
+    ASSERT_EQUAL(arena.ReservedBytes(), 0u);
+
+    const auto first = arena.Append("Hello");
+    const auto second = arena.Append("");
+    ASSERT_EQUAL(arena.View(first), "Hello\n");
+    ASSERT_EQUAL(arena.View(second), "\n");
+    ASSERT(arena.View(first).data() + 6 == arena.View(second).data());
+    ASSERT_EQUAL(arena.ReservedBytes(), CommentArena::kPageSize);
+
+    const string filler(1000, 'x');
+    vector<CommentArena::Ref> refs;
+    for (int i = 0; i < 100; ++i) {
+        refs.push_back(arena.Append(filler));
+    }
+    const string huge(CommentArena::kPageSize * 2, 'y');
+    const auto huge_ref = arena.Append(huge);
+    const auto after_huge = arena.Append("after");
+
+    ASSERT_EQUAL(arena.ReservedBytes(), CommentArena::kPageSize * 4 + 1);
+    ASSERT_EQUAL(arena.View(huge_ref), huge + '\n');
+    // A comment too long for a page doesn't close the open one
+    ASSERT(arena.View(refs.back()).data() + 1001 == arena.View(after_huge).data());
+    for (const auto& ref : refs) {
+        ASSERT_EQUAL(arena.View(ref), filler + '\n');
+    }
+    ASSERT_EQUAL(arena.View(first), "Hello\n");
+
+    // Users 0 and 1 live in different shards, so each one's history is contiguous in its arena and
+    // a chunk of the listing is a single fragment, or two where it crosses a page
+    CommentServer cs;
+    cs.ServeRequest({"POST", "/add_user"});
+    cs.ServeRequest({"POST", "/add_user"});
+    string history;
+    for (int i = 0; i < 5000; ++i) {
+        const string comment = "comment " + to_string(i);
+        history += comment + '\n';
+        cs.ServeRequest({"POST", "/add_comment", "0 " + comment});
+        cs.ServeRequest({"POST", "/add_comment", "1 filler"});
+    }
+
+    HttpResponse listing = cs.ServeRequest({"GET", "/user_comments", "", {{"user_id", "0"}}});
+    string head;
+    vector<iovec> buffers;
+    listing.AppendTo(head, buffers);
+    string body;
+    size_t max_chunk_buffers = 0;
+    while (listing.HasMoreChunks()) {
+        buffers.clear();
+        listing.AppendNextChunk(buffers);
+        max_chunk_buffers = max(max_chunk_buffers, buffers.size());
+        for (size_t i = 1; i + 1 < buffers.size(); ++i) {
+            body.append(static_cast<const char*>(buffers[i].iov_base), buffers[i].iov_len);
+        }
+    }
+    ASSERT(max_chunk_buffers <= 4);
+    ASSERT_EQUAL(body, history);
+}
+
+void TestCommentStorageSpeed() {
+    const size_t user_count = 1000;
+    const size_t comment_count = 200000;
+    vector<string> bodies;
+    for (size_t i = 0; i < comment_count; ++i) {
+        bodies.push_back(to_string(i % user_count) + " Comment number " + to_string(i) + " from a prolific user");
+    }
+
+    auto report = [comment_count](const string& name, size_t allocations, size_t bytes) {
+        cerr << name << ": " << static_cast<double>(allocations) / comment_count << " allocations per comment, "
+             << bytes * (1000000 / comment_count) / (1 << 20) << " MiB per million comments" << endl;
+    };
+
+    // The previous layout: one string per comment in a per-user container
+    {
+        const size_t start_allocations = AllocationCount();
+        const size_t start_bytes = LiveHeapBytes();
+        vector<deque<string>> users(user_count);
+        {
+            LOG_DURATION("200k comments appended as separate strings");
+            for (const string& body : bodies) {
+                auto [user_id, comment] = ParseIdAndContent(body);
+                users[user_id].push_back(string(comment) + '\n');
+            }
+        }
+        report("Separate strings", AllocationCount() - start_allocations, LiveHeapBytes() - start_bytes);
+    }
+
+    {
+        const size_t start_allocations = AllocationCount();
+        const size_t start_bytes = LiveHeapBytes();
+        CommentArena arena;
+        vector<vector<CommentArena::Ref>> users(user_count);
+        {
+            LOG_DURATION("200k comments appended to arena pages");
+            for (const string& body : bodies) {
+                auto [user_id, comment] = ParseIdAndContent(body);
+                users[user_id].push_back(arena.Append(comment));
+            }
+        }
+        report("Arena pages", AllocationCount() - start_allocations, LiveHeapBytes() - start_bytes);
+    }
+
+    {
+        CommentServer cs;
+        for (size_t i = 0; i < user_count; ++i) {
+            cs.ServeRequest({"POST", "/add_user"});
+        }
+
+        const size_t start_allocations = AllocationCount();
+        const size_t start_bytes = LiveHeapBytes();
+        {
+            LOG_DURATION("200k add_comment requests");
+            for (const string& body : bodies) {
+                cs.ServeRequest({"POST", "/add_comment", body});
+            }
+        }
+        report("CommentServer", AllocationCount() - start_allocations, LiveHeapBytes() - start_bytes);
+
+        stringstream output;
+        output << cs.ServeRequest({"GET", "/user_comments", "", {{"user_id", "7"}}});
+        ParsedResponse listing;
+        output >> listing;
+        ASSERT_EQUAL(count(listing.content.begin(), listing.content.end(), '\n'), 200);
+    }
+}
+
+string MakeTempPath(const string& name) {
+    const auto path = filesystem::temp_directory_path() / name;
+    filesystem::remove_all(path);
+    return path.string();
+}
+
+string_view PolicyName(SyncPolicy policy) {
+    switch (policy) {
+        case SyncPolicy::Always:
+            return "fsync before every answer";
+        case SyncPolicy::Grouped:
+            return "fsync every 128 events";
+        case SyncPolicy::Never:
+            return "no fsync";
+    }
+    return {};
+}
+
+void TestCommentLogRecovery() {
+    const string path = MakeTempPath("comment_server_recovery.log");
+    const ParsedResponse ok{200};
+    const ParsedResponse redirect_to_captcha{302, {{"Location", "/captcha"}}, {}};
+
+    for (SyncPolicy policy : {SyncPolicy::Always, SyncPolicy::Grouped, SyncPolicy::Never}) {
+        filesystem::remove(path);
+        const CommentLogOptions options{policy, 4};
+        {
+            CommentServer cs(path, options);
+            Test(cs, {"POST", "/add_user"}, {200, {}, "0"});
+            Test(cs, {"POST", "/add_user"}, {200, {}, "1"});
+            Test(cs, {"POST", "/add_comment", "0 Hello"}, ok);
+            Test(cs, {"POST", "/add_comment", "1 Hi"}, ok);
+            Test(cs, {"POST", "/add_comment", "1 Buy my goods"}, ok);
+            Test(cs, {"POST", "/add_comment", "1 Enlarge"}, ok);
+            Test(cs, {"POST", "/add_comment", "1 Buy my goods"}, redirect_to_captcha);
+            Test(cs, {"POST", "/add_comment", "0 What are you selling?"}, ok);
+        }
+        {
+            CommentServer cs(path, options);
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", "0"}}}, {200, {}, "Hello\nWhat are you selling?\n"});
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", "1"}}}, {200, {}, "Hi\nBuy my goods\nEnlarge\n"});
+            Test(cs, {"POST", "/add_comment", "1 Still selling"}, redirect_to_captcha);
+            Test(cs, {"POST", "/add_user"}, {200, {}, "2"});
+            Test(cs, {"POST", "/checkcaptcha", "1 42"}, ok);
+            Test(cs, {"POST", "/add_comment", "1 Sorry! No spam any more"}, ok);
+        }
+
+        {
+            ofstream log(path, ios::binary | ios::app);
+            log << "torn";
+        }
+        {
+            CommentServer cs(path, options);
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", "1"}}},
+                 {200, {}, "Hi\nBuy my goods\nEnlarge\nSorry! No spam any more\n"});
+            Test(cs, {"POST", "/add_user"}, {200, {}, "3"});
+            Test(cs, {"POST", "/add_comment", "3 After the torn tail"}, ok);
+        }
+        {
+            CommentServer cs(path, options);
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", "3"}}}, {200, {}, "After the torn tail\n"});
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", "2"}}}, {200, {}, ""});
+        }
+    }
+
+    // A lone event reaches the file within max_commit_delay, long before its group fills up
+    for (SyncPolicy policy : {SyncPolicy::Grouped, SyncPolicy::Never}) {
+        filesystem::remove(path);
+        CommentServer cs(path, {policy, 128, chrono::milliseconds(20)});
+        Test(cs, {"POST", "/add_user"}, {200, {}, "0"});
+        Test(cs, {"POST", "/add_comment", "0 Quiet day"}, ok);
+
+        this_thread::sleep_for(chrono::milliseconds(200));
+        const CommentLogContents contents = ReadCommentLog(path);
+        ASSERT_EQUAL(contents.events.size(), 2u);
+        ASSERT_EQUAL(contents.events[1].comment, "Quiet day");
+    }
+
+    // The spam streak is not logged, so a restart starts it afresh instead of counting a banned
+    // user's attempt into someone else's streak
+    filesystem::remove(path);
+    {
+        CommentServer cs(path);
+        Test(cs, {"POST", "/add_user"}, {200, {}, "0"});
+        Test(cs, {"POST", "/add_user"}, {200, {}, "1"});
+        for (int i = 0; i < 3; ++i) {
+            Test(cs, {"POST", "/add_comment", "0 Spam"}, ok);
+        }
+        Test(cs, {"POST", "/add_comment", "0 Spam"}, redirect_to_captcha);
+        Test(cs, {"POST", "/add_comment", "1 First"}, ok);
+        Test(cs, {"POST", "/add_comment", "0 Spam"}, redirect_to_captcha);
+        Test(cs, {"POST", "/add_comment", "1 Second"}, ok);
+    }
+    {
+        CommentServer cs(path);
+        for (int i = 0; i < 3; ++i) {
+            Test(cs, {"POST", "/add_comment", "1 More"}, ok);
+        }
+        Test(cs, {"POST", "/add_comment", "1 More"}, redirect_to_captcha);
+        Test(cs, {"POST", "/add_comment", "0 Spam"}, redirect_to_captcha);
+        Test(cs, {"GET", "/user_comments", "", {{"user_id", "1"}}}, {200, {}, "First\nSecond\nMore\nMore\nMore\n"});
+    }
+
+    // Concurrent writers share fdatasyncs; everything they were told is stored must come back
+    filesystem::remove(path);
+    vector<string> histories(4);
+    {
+        CommentServer cs(path, {SyncPolicy::Always});
+        vector<future<void>> writers;
+        for (size_t t = 0; t < histories.size(); ++t) {
+            cs.ServeRequest({"POST", "/add_user"});
+            writers.push_back(async(launch::async, [&cs, &history = histories[t], t] {
+                for (int i = 0; i < 100;) {
+                    const string comment = "comment " + to_string(i);
+                    const string body = to_string(t) + " " + comment;
+                    stringstream output;
+                    output << cs.ServeRequest({"POST", "/add_comment", body});
+                    ParsedResponse response;
+                    output >> response;
+
+                    if (response.code == 200) {
+                        history += comment + '\n';
+                        ++i;
+                    } else {
+                        const string answer = to_string(t) + " 42";
+                        cs.ServeRequest({"POST", "/checkcaptcha", answer});
+                    }
+                }
+            }));
+        }
+        for (auto& writer : writers) {
+            writer.get();
+        }
+    }
+    {
+        CommentServer cs(path);
+        for (size_t t = 0; t < histories.size(); ++t) {
+            Test(cs, {"GET", "/user_comments", "", {{"user_id", to_string(t)}}}, {200, {}, histories[t]});
+        }
+    }
+
+    filesystem::remove(path);
+}
+
+void TestCommentLogSpeed() {
+    const string path = MakeTempPath("comment_server_speed.log");
+    const size_t comment_count = 100000;
+
+    auto add_comments = [](CommentServer& cs, size_t count, size_t first_user, size_t user_count) {
+        for (size_t i = 0; i < count; ++i) {
+            const string body = to_string(first_user + i % user_count) + " Comment number " + to_string(i);
+            cs.ServeRequest({"POST", "/add_comment", body});
+        }
+    };
+
+    {
+        CommentServer cs;
+        cs.ServeRequest({"POST", "/add_user"});
+        cs.ServeRequest({"POST", "/add_user"});
+        LOG_DURATION("100k add_comment requests, no log");
+        add_comments(cs, comment_count, 0, 2);
+    }
+
+    for (SyncPolicy policy : {SyncPolicy::Never, SyncPolicy::Grouped, SyncPolicy::Always}) {
+        filesystem::remove(path);
+        const size_t count = policy == SyncPolicy::Always ? 2000 : comment_count;
+
+        CommentServer cs(path, {policy});
+        cs.ServeRequest({"POST", "/add_user"});
+        cs.ServeRequest({"POST", "/add_user"});
+        LOG_DURATION(to_string(count / 1000) + "k add_comment requests, " + string(PolicyName(policy)));
+        add_comments(cs, count, 0, 2);
+    }
+
+    {
+        // Each fdatasync covers the comments of every thread that queued up behind the previous one
+        filesystem::remove(path);
+        CommentServer cs(path, {SyncPolicy::Always});
+        const size_t thread_count = 4;
+        for (size_t t = 0; t < 2 * thread_count; ++t) {
+            cs.ServeRequest({"POST", "/add_user"});
+        }
+
+        LOG_DURATION("2k add_comment requests from 4 threads, fsync before every answer");
+        vector<future<void>> writers;
+        for (size_t t = 0; t < thread_count; ++t) {
+            writers.push_back(async(launch::async, [&cs, &add_comments, t] {
+                add_comments(cs, 500, 2 * t, 2);
+            }));
+        }
+        for (auto& writer : writers) {
+            writer.get();
+        }
+    }
+
+    filesystem::remove(path);
+    {
+        CommentServer cs(path, {SyncPolicy::Never});
+        cs.ServeRequest({"POST", "/add_user"});
+        cs.ServeRequest({"POST", "/add_user"});
+        add_comments(cs, comment_count, 0, 2);
+    }
+    {
+        LOG_DURATION("Replaying 100k comments");
+        CommentServer cs(path);
+        stringstream output;
+        output << cs.ServeRequest({"GET", "/user_comments", "", {{"user_id", "1"}}});
+        ParsedResponse listing;
+        output >> listing;
+        ASSERT_EQUAL(count(listing.content.begin(), listing.content.end(), '\n'), comment_count / 2);
+    }
+
+    filesystem::remove(path);
+}
+
+vector<RouteTable<int>::Route> MakeRoutes(size_t count) {
+    vector<RouteTable<int>::Route> routes;
+    for (size_t i = 0; i < count; ++i) {
+        routes.push_back({i % 3 == 0 ? "POST" : "GET", "/api/v1/resource_" + to_string(i), static_cast<int>(i)});
+    }
+    return routes;
+}
+
+void TestRouteTable() {
+    const auto routes = MakeRoutes(50);
+    const RouteTable<int> table(routes);
+    ASSERT_EQUAL(table.Size(), 50u);
+
+    for (const auto& route : routes) {
+        const int* value = table.Find(route.method, route.path);
+        ASSERT(value != nullptr);
+        ASSERT_EQUAL(*value, route.value);
+        ASSERT(table.Find(route.method == "GET" ? "POST" : "GET", route.path) == nullptr);
+        ASSERT(table.Find(route.method, route.path + "/") == nullptr);
+    }
+    ASSERT(table.Find("GET", "/") == nullptr);
+    ASSERT(RouteTable<int>().Find("GET", "/") == nullptr);
+
+    try {
+        RouteTable<int>({{"GET", "/a", 1}, {"GET", "/a", 2}});
+        ASSERT(false);
+    } catch (const invalid_argument&) {
+    }
+}
+
+void TestRouteDispatchSpeed() {
+    const auto routes = MakeRoutes(50);
+    const RouteTable<int> table(routes);
+
+    vector<pair<string, string>> requests;
+    for (size_t i = 0; i < 1000; ++i) {
+        const auto& route = routes[(i * 7919) % routes.size()];
+        requests.push_back({route.method, route.path});
+    }
+    const int rounds = 200;
+
+    int64_t chain_sum = 0;
+    {
+        LOG_DURATION("200k dispatches over 50 routes, comparison chain");
+        for (int round = 0; round < rounds; ++round) {
+            for (const auto& [method, path] : requests) {
+                for (const auto& route : routes) {
+                    if (method == route.method && path == route.path) {
+                        chain_sum += route.value;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    int64_t table_sum = 0;
+    {
+        LOG_DURATION("200k dispatches over 50 routes, perfect hash");
+        for (int round = 0; round < rounds; ++round) {
+            for (const auto& [method, path] : requests) {
+                table_sum += *table.Find(method, path);
+            }
+        }
+    }
+
+    ASSERT_EQUAL(table_sum, chain_sum);
+}
+
 int main() {
     TestRunner tr;
     RUN_TEST(tr, TestServer<CommentServer>);
+    RUN_TEST(tr, TestRequestParser);
+    RUN_TEST(tr, TestRequestParserSpeed);
+    RUN_TEST(tr, TestEpollServer);
+    RUN_TEST(tr, TestEpollServerHandlerErrors);
+    RUN_TEST(tr, TestEpollServerBackPressure);
+    RUN_TEST(tr, TestEpollServerLoad);
+    RUN_TEST(tr, TestConcurrentCommentServer);
+    RUN_TEST(tr, TestWorkerThreadScaling);
+    RUN_TEST(tr, TestCommentListingSpeed);
+    RUN_TEST(tr, TestPaginatedComments);
+    RUN_TEST(tr, TestStreamedCommentsOverEpoll);
+    RUN_TEST(tr, TestCommentArena);
+    RUN_TEST(tr, TestCommentStorageSpeed);
+    RUN_TEST(tr, TestCommentLogRecovery);
+    RUN_TEST(tr, TestCommentLogSpeed);
+    RUN_TEST(tr, TestRouteTable);
+    RUN_TEST(tr, TestRouteDispatchSpeed);
 }
\ No newline at end of file
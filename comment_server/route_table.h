@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Maps (method, path) to a value through a perfect hash built once from the full route list:
+// every route owns a distinct slot, so a lookup hashes the request once and compares one entry.
+template <typename Value>
+class RouteTable {
+public:
+    struct Route {
+        string method;
+        string path;
+        Value value;
+    };
+
+    RouteTable() = default;
+
+    explicit RouteTable(vector<Route> routes) : routes_(move(routes)) {
+        for (size_t i = 0; i < routes_.size(); ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (routes_[i].method == routes_[j].method && routes_[i].path == routes_[j].path)
+                    throw invalid_argument("Duplicate route " + routes_[i].method + " " + routes_[i].path);
+            }
+        }
+
+        size_t capacity = 1;
+        while (capacity < 2 * routes_.size())
+            capacity *= 2;
+
+        for (uint64_t attempt = 0; !TryBuild(capacity, attempt + 1); ++attempt) {
+            if (attempt % kSeedsPerCapacity == kSeedsPerCapacity - 1)
+                capacity *= 2;
+        }
+    }
+
+    const Value* Find(string_view method, string_view path) const {
+        if (routes_.empty())
+            return nullptr;
+
+        const uint32_t index = slots_[Hash(seed_, method, path) & (slots_.size() - 1)];
+        if (index == kEmpty)
+            return nullptr;
+
+        const Route& route = routes_[index];
+        return route.method == method && route.path == path ? &route.value : nullptr;
+    }
+
+    size_t Size() const {
+        return routes_.size();
+    }
+
+private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    static constexpr uint64_t kSeedsPerCapacity = 64;
+
+    vector<Route> routes_;
+    vector<uint32_t> slots_;
+    uint64_t seed_ = 0;
+
+    static uint64_t Hash(uint64_t seed, string_view method, string_view path) {
+        uint64_t hash = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+        auto mix = [&hash](string_view text) {
+            for (char c : text) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+            }
+            hash = (hash ^ ' ') * 1099511628211ULL;
+        };
+
+        mix(method);
+        mix(path);
+        return hash ^ (hash >> 29);
+    }
+
+    bool TryBuild(size_t capacity, uint64_t seed) {
+        vector<uint32_t> slots(capacity, kEmpty);
+
+        for (size_t i = 0; i < routes_.size(); ++i) {
+            uint32_t& slot = slots[Hash(seed, routes_[i].method, routes_[i].path) & (capacity - 1)];
+            if (slot != kEmpty)
+                return false;
+            slot = static_cast<uint32_t>(i);
+        }
+
+        slots_ = move(slots);
+        seed_ = seed;
+        return true;
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "hasher_holder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+struct FlatHashSetImageHeader {
+    uint64_t magic;
+    uint64_t value_size;
+    uint64_t group_count;
+    uint64_t size;
+};
+
+constexpr uint64_t kFlatHashSetImageMagic = 0x31474d4953485346ull;
+
+template <typename Type, typename Hasher>
+class FlatHashSetImage;
+
+template <typename Type, typename Hasher>
+class FlatHashSet : private HasherHolder<Hasher> {
+public:
+    using HasherHolder<Hasher>::GetHasher;
+
+    explicit FlatHashSet(size_t capacity = 0, const Hasher& hasher = {})
+        : HasherHolder<Hasher>(hasher) {
+        Resize(GroupCountFor(capacity));
+    }
+
+    void Add(const Type& value) {
+        if (Has(value))
+            return;
+
+        if (size_ + deleted_ + 1 > MaxSize())
+            Resize(size_ + 1 > MaxSize() / 2 ? group_count_ * 2 : group_count_);
+
+        const uint64_t hash = Hash(value);
+        const size_t index = FindInsertSlot(hash);
+        if (ctrl_[index] == kDeleted)
+            --deleted_;
+
+        ctrl_[index] = H2(hash);
+        slots_[index] = value;
+        ++size_;
+    }
+
+    bool Has(const Type& value) const {
+        return FindSlot(value) != kNotFound;
+    }
+
+    void Erase(const Type& value) {
+        const size_t index = FindSlot(value);
+        if (index == kNotFound)
+            return;
+
+        const size_t group_start = index - index % kGroupSize;
+        if (MatchEmpty(&ctrl_[group_start]) != 0) {
+            ctrl_[index] = kEmpty;
+        } else {
+            ctrl_[index] = kDeleted;
+            ++deleted_;
+        }
+        --size_;
+    }
+
+    void Reserve(size_t count) {
+        if (count > MaxSize())
+            Resize(GroupCountFor(count));
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    size_t SlotCount() const {
+        return slots_.size();
+    }
+
+    void Save(ostream& output) const {
+        static_assert(is_trivially_copyable_v<Type>, "Only trivially copyable values can be saved");
+
+        const FlatHashSetImageHeader header{kFlatHashSetImageMagic, sizeof(Type), group_count_, size_};
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.write(reinterpret_cast<const char*>(ctrl_.data()), ctrl_.size());
+        output.write(reinterpret_cast<const char*>(slots_.data()), slots_.size() * sizeof(Type));
+        if (!output)
+            throw runtime_error("Unable to write the hash set image");
+    }
+
+private:
+    friend class FlatHashSetImage<Type, Hasher>;
+
+    static constexpr size_t kGroupSize = 16;
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+    static constexpr int8_t kEmpty = -128;
+    static constexpr int8_t kDeleted = -2;
+
+    vector<int8_t> ctrl_;
+    vector<Type> slots_;
+    size_t group_count_ = 0;
+    size_t size_ = 0;
+    size_t deleted_ = 0;
+
+    static uint64_t Mix(size_t raw_hash) {
+        const uint64_t hash = static_cast<uint64_t>(raw_hash) * 0x9E3779B97F4A7C15ull;
+        return hash ^ (hash >> 32);
+    }
+
+    uint64_t Hash(const Type& value) const {
+        return Mix(GetHasher()(value));
+    }
+
+    static int8_t H2(uint64_t hash) {
+        return static_cast<int8_t>(hash >> 57);
+    }
+
+    static size_t H1(uint64_t hash, size_t group_count) {
+        return static_cast<size_t>(hash >> 7) & (group_count - 1);
+    }
+
+    size_t MaxSize() const {
+        return slots_.size() / 8 * 7;
+    }
+
+    static size_t GroupCountFor(size_t count) {
+        size_t group_count = 1;
+        while (group_count * kGroupSize / 8 * 7 < count)
+            group_count *= 2;
+
+        return group_count;
+    }
+
+#ifdef __SSE2__
+    static uint32_t Match(const int8_t* group, int8_t h2) {
+        const __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const int8_t* group) {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group)));
+    }
+#else
+    static uint32_t Match(const int8_t* group, int8_t h2) {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupSize; ++i)
+            mask |= static_cast<uint32_t>(group[i] == h2) << i;
+
+        return mask;
+    }
+
+    static uint32_t MatchEmptyOrDeleted(const int8_t* group) {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupSize; ++i)
+            mask |= static_cast<uint32_t>(group[i] < 0) << i;
+
+        return mask;
+    }
+#endif
+
+    static uint32_t MatchEmpty(const int8_t* group) {
+        return Match(group, kEmpty);
+    }
+
+    static size_t LowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#else
+        size_t bit = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    static size_t FindSlotIn(const int8_t* ctrl, const Type* slots, size_t group_count,
+                             uint64_t hash, const Type& value) {
+        const int8_t h2 = H2(hash);
+        size_t group = H1(hash, group_count);
+
+        for (size_t probe = 1; probe <= group_count; ++probe) {
+            const size_t group_start = group * kGroupSize;
+            const int8_t* group_ctrl = ctrl + group_start;
+
+            for (uint32_t mask = Match(group_ctrl, h2); mask != 0; mask &= mask - 1) {
+                const size_t index = group_start + LowestBit(mask);
+                if (slots[index] == value)
+                    return index;
+            }
+
+            if (MatchEmpty(group_ctrl) != 0)
+                return kNotFound;
+
+            group = (group + probe) & (group_count - 1);
+        }
+
+        return kNotFound;
+    }
+
+    size_t FindSlot(const Type& value) const {
+        return FindSlotIn(ctrl_.data(), slots_.data(), group_count_, Hash(value), value);
+    }
+
+    size_t FindInsertSlot(uint64_t hash) const {
+        size_t group = H1(hash, group_count_);
+
+        for (size_t probe = 1;; ++probe) {
+            const size_t group_start = group * kGroupSize;
+
+            if (uint32_t mask = MatchEmptyOrDeleted(&ctrl_[group_start]); mask != 0)
+                return group_start + LowestBit(mask);
+
+            group = (group + probe) & (group_count_ - 1);
+        }
+    }
+
+    void Resize(size_t group_count) {
+        vector<int8_t> old_ctrl = move(ctrl_);
+        vector<Type> old_slots = move(slots_);
+
+        group_count_ = group_count;
+        ctrl_.assign(group_count * kGroupSize, kEmpty);
+        slots_.assign(group_count * kGroupSize, Type{});
+        deleted_ = 0;
+
+        for (size_t i = 0; i < old_ctrl.size(); ++i) {
+            if (old_ctrl[i] >= 0) {
+                const uint64_t hash = Hash(old_slots[i]);
+                const size_t index = FindInsertSlot(hash);
+                ctrl_[index] = H2(hash);
+                slots_[index] = move(old_slots[i]);
+            }
+        }
+    }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "flat_hash_set.h"
+#include "hasher_holder.h"
+#include "mapped_file.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+template <typename Type, typename Hasher>
+class FlatHashSetImage : private HasherHolder<Hasher> {
+public:
+    using HasherHolder<Hasher>::GetHasher;
+
+    explicit FlatHashSetImage(const string& path, const Hasher& hasher = {})
+        : HasherHolder<Hasher>(hasher)
+        , file_(path) {
+        static_assert(is_trivially_copyable_v<Type>, "Only trivially copyable values can be mapped");
+        static_assert(alignof(Type) <= 16, "Slots are only 16-byte aligned in the image");
+
+        if (file_.Size() < sizeof(FlatHashSetImageHeader))
+            throw invalid_argument("Image is too small: " + path);
+
+        FlatHashSetImageHeader header;
+        memcpy(&header, file_.Data(), sizeof(header));
+
+        if (header.magic != kFlatHashSetImageMagic)
+            throw invalid_argument("Not a hash set image: " + path);
+        if (header.value_size != sizeof(Type))
+            throw invalid_argument("Image value size mismatch: " + path);
+
+        // Bounded by the file before multiplying, so a corrupt count can't wrap around to a matching size
+        if (header.group_count > (file_.Size() - sizeof(header)) / (Set::kGroupSize * (1 + sizeof(Type))))
+            throw invalid_argument("Corrupted hash set image: " + path);
+
+        const size_t slot_count = header.group_count * Set::kGroupSize;
+        if (header.group_count == 0 || (header.group_count & (header.group_count - 1)) != 0
+                || file_.Size() != sizeof(header) + slot_count * (1 + sizeof(Type)))
+            throw invalid_argument("Corrupted hash set image: " + path);
+
+        group_count_ = header.group_count;
+        size_ = header.size;
+        ctrl_ = reinterpret_cast<const int8_t*>(file_.Data() + sizeof(header));
+        slots_ = reinterpret_cast<const Type*>(file_.Data() + sizeof(header) + slot_count);
+    }
+
+    bool Has(const Type& value) const {
+        return Set::FindSlotIn(ctrl_, slots_, group_count_, Set::Mix(GetHasher()(value)), value)
+            != Set::kNotFound;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    using Set = FlatHashSet<Type, Hasher>;
+
+    MappedFile file_;
+    const int8_t* ctrl_ = nullptr;
+    const Type* slots_ = nullptr;
+    size_t group_count_ = 0;
+    size_t size_ = 0;
+};
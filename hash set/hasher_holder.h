@@ -0,0 +1,28 @@
+#pragma once
+
+#include <type_traits>
+
+using namespace std;
+
+template <typename Hasher, bool = is_empty_v<Hasher> && !is_final_v<Hasher>>
+class HasherHolder : private Hasher {
+public:
+    explicit HasherHolder(const Hasher& hasher) : Hasher(hasher) {}
+
+    const Hasher& GetHasher() const {
+        return *this;
+    }
+};
+
+template <typename Hasher>
+class HasherHolder<Hasher, false> {
+public:
+    explicit HasherHolder(const Hasher& hasher) : hasher_(hasher) {}
+
+    const Hasher& GetHasher() const {
+        return hasher_;
+    }
+
+private:
+    Hasher hasher_;
+};
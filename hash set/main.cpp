@@ -1,51 +1,234 @@
 #include "test_runner.h"
+#include "profile.h"
+#include "flat_hash_set.h"
+#include "flat_hash_set_image.h"
+#include "hasher_holder.h"
 
+#include <filesystem>
 #include <forward_list>
+#include <fstream>
+#include <future>
+#include <mutex>
 #include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <set>
+#include <stdexcept>
 
 using namespace std;
 
+inline void Prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address);
+#endif
+}
+
 template <typename Type, typename Hasher>
-class HashSet {
+class HashSet : private HasherHolder<Hasher> {
 public:
     using BucketList = forward_list<Type>;
+    using HasherHolder<Hasher>::GetHasher;
 
     explicit HashSet(size_t num_buckets, const Hasher& hasher = {})
-        : hasher_(hasher)
-        , buckets_(num_buckets) {}
+        : HasherHolder<Hasher>(hasher)
+        , buckets_(max<size_t>(num_buckets, 1)) {}
 
     void Add(const Type& value) {
         if (Has(value))
             return;
 
+        if (size_ + 1 > MaxSizeFor(buckets_.size()))
+            Rehash(max(buckets_.size() * 2, MinBucketCountFor(size_ + 1)));
+
         buckets_[GetBucketIndex(value)].push_front(value);
+        ++size_;
     }
 
     bool Has(const Type& value) const {
-        BucketList bucket = buckets_.at(GetBucketIndex(value));
-
-        if (bucket.empty())
-            return false;
+        const BucketList& bucket = buckets_[GetBucketIndex(value)];
 
         return find(bucket.begin(), bucket.end(), value) != bucket.end();
     }
 
     void Erase(const Type& value) {
-        buckets_[GetBucketIndex(value)].remove(value);
+        BucketList& bucket = buckets_[GetBucketIndex(value)];
+
+        for (auto prev = bucket.before_begin(); next(prev) != bucket.end(); ++prev) {
+            if (*next(prev) == value) {
+                bucket.erase_after(prev);
+                --size_;
+                return;
+            }
+        }
+    }
+
+    // Replaces the contents with values, which must not contain duplicates
+    template <typename Range>
+    void BuildFrom(const Range& values) {
+        const size_t count = size(values);
+        buckets_.assign(count > MaxSizeFor(buckets_.size()) ? MinBucketCountFor(count) : buckets_.size(), {});
+
+        for (const Type& value : values) {
+            buckets_[GetBucketIndex(value)].push_front(value);
+        }
+        size_ = count;
+    }
+
+    void HasMany(const Type* values, size_t count, bool* result) const {
+        array<size_t, kPrefetchDistance> bucket_indices;
+
+        for (size_t i = 0; i < min(count, kPrefetchDistance); ++i) {
+            bucket_indices[i] = GetBucketIndex(values[i]);
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i + kPrefetchDistance / 2 < count) {
+                const BucketList& bucket = buckets_[bucket_indices[(i + kPrefetchDistance / 2) % kPrefetchDistance]];
+                if (!bucket.empty())
+                    Prefetch(&bucket.front());
+            }
+
+            const BucketList& bucket = buckets_[bucket_indices[i % kPrefetchDistance]];
+            result[i] = find(bucket.begin(), bucket.end(), values[i]) != bucket.end();
+
+            if (i + kPrefetchDistance < count) {
+                const size_t index = GetBucketIndex(values[i + kPrefetchDistance]);
+                bucket_indices[i % kPrefetchDistance] = index;
+                Prefetch(&buckets_[index]);
+            }
+        }
     }
 
     const BucketList& GetBucket(const Type& value) const {
         return buckets_.at(GetBucketIndex(value));
     }
 
+    void Reserve(size_t count) {
+        if (count > MaxSizeFor(buckets_.size()))
+            Rehash(MinBucketCountFor(count));
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    size_t BucketCount() const {
+        return buckets_.size();
+    }
+
+    float LoadFactor() const {
+        return static_cast<float>(size_) / buckets_.size();
+    }
+
+    float MaxLoadFactor() const {
+        return max_load_factor_;
+    }
+
+    void SetMaxLoadFactor(float max_load_factor) {
+        if (max_load_factor <= 0)
+            throw invalid_argument("Max load factor must be positive");
+
+        max_load_factor_ = max_load_factor;
+        Reserve(size_);
+    }
+
 private:
-    const Hasher& hasher_;
+    static constexpr size_t kPrefetchDistance = 8;
+
     vector<BucketList> buckets_;
+    size_t size_ = 0;
+    float max_load_factor_ = 1.0f;
 
     size_t GetBucketIndex(const Type& value) const {
-        return hasher_(value) % buckets_.size();
+        return GetHasher()(value) % buckets_.size();
+    }
+
+    size_t MaxSizeFor(size_t bucket_count) const {
+        return static_cast<size_t>(bucket_count * max_load_factor_);
+    }
+
+    size_t MinBucketCountFor(size_t count) const {
+        return max<size_t>(static_cast<size_t>(ceil(count / max_load_factor_)), 1);
+    }
+
+    void Rehash(size_t bucket_count) {
+        vector<BucketList> new_buckets(bucket_count);
+
+        for (BucketList& bucket : buckets_) {
+            while (!bucket.empty()) {
+                BucketList& target = new_buckets[GetHasher()(bucket.front()) % bucket_count];
+                target.splice_after(target.before_begin(), bucket, bucket.before_begin());
+            }
+        }
+
+        buckets_ = move(new_buckets);
+    }
+};
+
+template <typename Type, typename Hasher>
+class ConcurrentHashSet : private HasherHolder<Hasher> {
+public:
+    using HasherHolder<Hasher>::GetHasher;
+
+    explicit ConcurrentHashSet(size_t shard_count, const Hasher& hasher = {})
+        : HasherHolder<Hasher>(hasher)
+        , shards_(max<size_t>(shard_count, 1)) {
+        for (Shard& shard : shards_) {
+            shard.set = HashSet<Type, Hasher>(1, hasher);
+        }
+    }
+
+    void Add(const Type& value) {
+        const size_t shard_index = GetShardIndex(value);
+        Shard& shard = shards_[shard_index];
+        lock_guard<mutex> guard(shard.guard);
+        shard.set.Add(value);
+    }
+
+    bool Has(const Type& value) const {
+        const size_t shard_index = GetShardIndex(value);
+        const Shard& shard = shards_[shard_index];
+        lock_guard<mutex> guard(shard.guard);
+        return shard.set.Has(value);
+    }
+
+    void Erase(const Type& value) {
+        const size_t shard_index = GetShardIndex(value);
+        Shard& shard = shards_[shard_index];
+        lock_guard<mutex> guard(shard.guard);
+        shard.set.Erase(value);
+    }
+
+    size_t Size() const {
+        size_t size = 0;
+
+        for (const Shard& shard : shards_) {
+            lock_guard<mutex> guard(shard.guard);
+            size += shard.set.Size();
+        }
+
+        return size;
+    }
+
+private:
+    // Each stripe's lock and header get their own cache line, so threads working on different
+    // stripes don't contend for it
+    struct alignas(64) Shard {
+        mutable mutex guard;
+        HashSet<Type, Hasher> set{1};
+    };
+
+    vector<Shard> shards_;
+
+    size_t GetShardIndex(const Type& value) const {
+        const uint64_t hash = static_cast<uint64_t>(GetHasher()(value)) * 0x9E3779B97F4A7C15ull;
+        return (hash >> 32) % shards_.size();
     }
 };
 
@@ -55,6 +238,20 @@ struct IntHasher {
     }
 };
 
+struct SeededIntHasher {
+    uint64_t seed;
+
+    static SeededIntHasher Random() {
+        return {(static_cast<uint64_t>(random_device()()) << 32) | random_device()()};
+    }
+
+    size_t operator()(int value) const {
+        uint64_t hash = (static_cast<uint64_t>(value) ^ seed) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+        return hash * 0xBF58476D1CE4E5B9ull;
+    }
+};
+
 struct TestValue {
     int value;
 
@@ -127,11 +324,537 @@ void TestEquivalence() {
     ASSERT_EQUAL(2, bucket.front().value);
 }
 
+void TestRehash() {
+    HashSet<int, IntHasher> hash_set(1);
+    for (int value = 0; value < 1000; ++value) {
+        hash_set.Add(value);
+        ASSERT(hash_set.LoadFactor() <= hash_set.MaxLoadFactor());
+    }
+
+    ASSERT_EQUAL(hash_set.Size(), 1000u);
+    ASSERT(hash_set.BucketCount() >= 1000u);
+    for (int value = 0; value < 1000; ++value) {
+        ASSERT(hash_set.Has(value));
+    }
+    ASSERT(!hash_set.Has(1000));
+}
+
+void TestReserve() {
+    HashSet<int, IntHasher> hash_set(10);
+    hash_set.Reserve(5000);
+
+    const size_t bucket_count = hash_set.BucketCount();
+    ASSERT(bucket_count >= 5000u);
+
+    for (int value = 0; value < 5000; ++value) {
+        hash_set.Add(value);
+    }
+    ASSERT_EQUAL(hash_set.BucketCount(), bucket_count);
+}
+
+void TestMaxLoadFactor() {
+    HashSet<int, IntHasher> hash_set(10);
+    for (int value = 0; value < 100; ++value) {
+        hash_set.Add(value);
+    }
+
+    hash_set.SetMaxLoadFactor(0.25f);
+    ASSERT(hash_set.LoadFactor() <= 0.25f);
+    ASSERT(hash_set.BucketCount() >= 400u);
+    for (int value = 0; value < 100; ++value) {
+        ASSERT(hash_set.Has(value));
+    }
+
+    try {
+        hash_set.SetMaxLoadFactor(0);
+        ASSERT(false);
+    } catch (invalid_argument&) {
+    }
+}
+
+void TestMixedAddErase() {
+    HashSet<int, IntHasher> hash_set(3);
+    set<int> expected;
+
+    default_random_engine engine(42);
+    uniform_int_distribution<int> value_dist(0, 2000);
+    bernoulli_distribution add_dist(0.6);
+
+    for (int i = 0; i < 20000; ++i) {
+        const int value = value_dist(engine);
+        if (add_dist(engine)) {
+            hash_set.Add(value);
+            expected.insert(value);
+        } else {
+            hash_set.Erase(value);
+            expected.erase(value);
+        }
+
+        ASSERT_EQUAL(hash_set.Size(), expected.size());
+        ASSERT(hash_set.LoadFactor() <= hash_set.MaxLoadFactor());
+    }
+
+    for (int value = 0; value <= 2000; ++value) {
+        ASSERT_EQUAL(hash_set.Has(value), expected.count(value) > 0);
+    }
+}
+
+void TestFlatSmoke() {
+    FlatHashSet<int, IntHasher> hash_set;
+    hash_set.Add(3);
+    hash_set.Add(4);
+
+    ASSERT(hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+    ASSERT(!hash_set.Has(5));
+
+    hash_set.Erase(3);
+
+    ASSERT(!hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+    ASSERT_EQUAL(hash_set.Size(), 1u);
+
+    hash_set.Add(4);
+    hash_set.Add(3);
+    hash_set.Add(5);
+
+    ASSERT(hash_set.Has(3));
+    ASSERT(hash_set.Has(4));
+    ASSERT(hash_set.Has(5));
+    ASSERT_EQUAL(hash_set.Size(), 3u);
+}
+
+void TestFlatEquivalence() {
+    FlatHashSet<TestValue, TestValueHasher> hash_set;
+    hash_set.Add(TestValue{2});
+    hash_set.Add(TestValue{3});
+
+    ASSERT(hash_set.Has(TestValue{2}));
+    ASSERT(hash_set.Has(TestValue{3}));
+    ASSERT_EQUAL(hash_set.Size(), 1u);
+}
+
+void TestFlatMixedAddErase() {
+    FlatHashSet<int, IntHasher> hash_set;
+    set<int> expected;
+
+    default_random_engine engine(42);
+    uniform_int_distribution<int> value_dist(-3000, 3000);
+    bernoulli_distribution add_dist(0.55);
+
+    for (int i = 0; i < 50000; ++i) {
+        const int value = value_dist(engine);
+        if (add_dist(engine)) {
+            hash_set.Add(value);
+            expected.insert(value);
+        } else {
+            hash_set.Erase(value);
+            expected.erase(value);
+        }
+
+        ASSERT_EQUAL(hash_set.Size(), expected.size());
+    }
+
+    for (int value = -3000; value <= 3000; ++value) {
+        ASSERT_EQUAL(hash_set.Has(value), expected.count(value) > 0);
+    }
+}
+
+template <typename Set>
+size_t CountHits(const Set& hash_set, const vector<int>& queries) {
+    size_t hits = 0;
+    for (int value : queries) {
+        hits += hash_set.Has(value);
+    }
+    return hits;
+}
+
+void TestLookupSpeed() {
+    const int value_count = 200000;
+
+    vector<int> hit_queries(value_count);
+    iota(hit_queries.begin(), hit_queries.end(), 0);
+    shuffle(hit_queries.begin(), hit_queries.end(), default_random_engine(1));
+
+    vector<int> miss_queries(value_count);
+    iota(miss_queries.begin(), miss_queries.end(), value_count);
+    shuffle(miss_queries.begin(), miss_queries.end(), default_random_engine(2));
+
+    HashSet<int, IntHasher> chained(value_count);
+    FlatHashSet<int, IntHasher> flat(value_count);
+    for (int value = 0; value < value_count; ++value) {
+        chained.Add(value);
+        flat.Add(value);
+    }
+
+    {
+        LOG_DURATION("Chained hits");
+        ASSERT_EQUAL(CountHits(chained, hit_queries), hit_queries.size());
+    }
+    {
+        LOG_DURATION("Flat hits");
+        ASSERT_EQUAL(CountHits(flat, hit_queries), hit_queries.size());
+    }
+    {
+        LOG_DURATION("Chained misses");
+        ASSERT_EQUAL(CountHits(chained, miss_queries), 0u);
+    }
+    {
+        LOG_DURATION("Flat misses");
+        ASSERT_EQUAL(CountHits(flat, miss_queries), 0u);
+    }
+}
+
+void TestBuildFrom() {
+    vector<int> values(1000);
+    iota(values.begin(), values.end(), -500);
+
+    HashSet<int, IntHasher> hash_set(1);
+    hash_set.Add(100000);
+    hash_set.BuildFrom(values);
+
+    ASSERT_EQUAL(hash_set.Size(), values.size());
+    ASSERT(hash_set.LoadFactor() <= hash_set.MaxLoadFactor());
+    ASSERT(!hash_set.Has(100000));
+    for (int value : values) {
+        ASSERT(hash_set.Has(value));
+    }
+
+    hash_set.Add(500);
+    hash_set.Add(0);
+    ASSERT_EQUAL(hash_set.Size(), values.size() + 1);
+}
+
+void TestHasMany() {
+    HashSet<int, IntHasher> hash_set(10);
+    for (int value = 0; value < 100; value += 3) {
+        hash_set.Add(value);
+    }
+
+    for (size_t count : {0, 1, 5, 8, 100}) {
+        vector<int> queries(count);
+        iota(queries.begin(), queries.end(), 0);
+
+        unique_ptr<bool[]> result(new bool[count]);
+        hash_set.HasMany(queries.data(), queries.size(), result.get());
+
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQUAL(result[i], hash_set.Has(queries[i]));
+        }
+    }
+}
+
+void TestBulkSpeed() {
+    const size_t value_count = 500000;
+
+    default_random_engine engine(7);
+    uniform_int_distribution<int> value_dist(0, numeric_limits<int>::max());
+
+    set<int> unique_values;
+    while (unique_values.size() < value_count) {
+        unique_values.insert(value_dist(engine));
+    }
+    vector<int> values(unique_values.begin(), unique_values.end());
+    shuffle(values.begin(), values.end(), engine);
+
+    vector<int> queries(value_count);
+    for (size_t i = 0; i < value_count; ++i) {
+        queries[i] = i % 2 == 0 ? values[(i * 7919) % value_count] : value_dist(engine);
+    }
+
+    HashSet<int, IntHasher> added(1);
+    {
+        LOG_DURATION("Add loop");
+        for (int value : values) {
+            added.Add(value);
+        }
+    }
+
+    HashSet<int, IntHasher> built(1);
+    {
+        LOG_DURATION("BuildFrom");
+        built.BuildFrom(values);
+    }
+    ASSERT_EQUAL(built.Size(), added.Size());
+
+    vector<char> expected(value_count);
+    {
+        LOG_DURATION("Has loop");
+        for (size_t i = 0; i < value_count; ++i) {
+            expected[i] = built.Has(queries[i]);
+        }
+    }
+
+    unique_ptr<bool[]> result(new bool[value_count]);
+    {
+        LOG_DURATION("HasMany");
+        built.HasMany(queries.data(), queries.size(), result.get());
+    }
+
+    for (size_t i = 0; i < value_count; ++i) {
+        ASSERT_EQUAL(result[i], static_cast<bool>(expected[i]));
+    }
+}
+
+void TestStatefulHasher() {
+    HashSet<int, SeededIntHasher> first(10, SeededIntHasher{1});
+    HashSet<int, SeededIntHasher> second(10, SeededIntHasher::Random());
+
+    for (int value = 0; value < 1000; value += 2) {
+        first.Add(value);
+        second.Add(value);
+    }
+
+    ASSERT_EQUAL(first.GetHasher().seed, 1u);
+    for (int value = 0; value < 1000; ++value) {
+        ASSERT_EQUAL(first.Has(value), value % 2 == 0);
+        ASSERT_EQUAL(second.Has(value), value % 2 == 0);
+    }
+
+    ASSERT(sizeof(HashSet<int, IntHasher>) < sizeof(HashSet<int, SeededIntHasher>));
+    ASSERT(sizeof(FlatHashSet<int, IntHasher>) < sizeof(FlatHashSet<int, SeededIntHasher>));
+}
+
+void TestSeededHasherSpread() {
+    HashSet<int, IntHasher> plain(1000);
+    HashSet<int, SeededIntHasher> seeded(1000, SeededIntHasher::Random());
+
+    for (int value = 0; value < 1000; ++value) {
+        plain.Add(value * 1000);
+        seeded.Add(value * 1000);
+    }
+
+    const auto& plain_bucket = plain.GetBucket(0);
+    const auto& seeded_bucket = seeded.GetBucket(0);
+    ASSERT(distance(plain_bucket.begin(), plain_bucket.end()) > 100);
+    ASSERT(distance(seeded_bucket.begin(), seeded_bucket.end()) < 10);
+}
+
+void TestHasherStorageSpeed() {
+    const int value_count = 200000;
+    const IntHasher int_hasher;
+
+    // A reference Hasher is the layout HashSet had before HasherHolder: a const Hasher& member
+    HashSet<int, IntHasher> by_value(value_count);
+    HashSet<int, const IntHasher&> by_reference(value_count, int_hasher);
+    for (int value = 0; value < value_count; ++value) {
+        by_value.Add(value);
+        by_reference.Add(value);
+    }
+
+    size_t by_value_hits = 0;
+    {
+        LOG_DURATION("Hasher by value");
+        for (int i = 0; i < 5; ++i) {
+            for (int value = 0; value < 2 * value_count; ++value) {
+                by_value_hits += by_value.Has(value);
+            }
+        }
+    }
+
+    size_t by_reference_hits = 0;
+    {
+        LOG_DURATION("Hasher by reference");
+        for (int i = 0; i < 5; ++i) {
+            for (int value = 0; value < 2 * value_count; ++value) {
+                by_reference_hits += by_reference.Has(value);
+            }
+        }
+    }
+
+    ASSERT_EQUAL(by_value_hits, by_reference_hits);
+}
+
+void RunConcurrentAdds(ConcurrentHashSet<int, IntHasher>& hash_set, size_t thread_count, int value_count) {
+    vector<future<void>> futures;
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        futures.push_back(async(launch::async, [&hash_set, thread_count, value_count, i] {
+            for (int value = i; value < value_count; value += thread_count) {
+                hash_set.Add(value);
+                hash_set.Add(value / 2);
+            }
+        }));
+    }
+}
+
+void TestConcurrentAdd() {
+    const int value_count = 100000;
+
+    ConcurrentHashSet<int, IntHasher> hash_set(16);
+    RunConcurrentAdds(hash_set, 4, value_count);
+
+    ASSERT_EQUAL(hash_set.Size(), static_cast<size_t>(value_count));
+    for (int value = 0; value < value_count; ++value) {
+        ASSERT(hash_set.Has(value));
+    }
+    ASSERT(!hash_set.Has(value_count));
+}
+
+void TestConcurrentAddAndErase() {
+    ConcurrentHashSet<int, IntHasher> hash_set(8);
+
+    auto adder = [&hash_set](int from) {
+        for (int value = from; value < 40000; value += 2) {
+            hash_set.Add(value);
+        }
+    };
+    auto eraser = [&hash_set] {
+        for (int value = 1; value < 40000; value += 2) {
+            hash_set.Erase(value);
+        }
+    };
+
+    {
+        auto even = async(launch::async, adder, 0);
+        auto odd = async(launch::async, adder, 1);
+    }
+    ASSERT_EQUAL(hash_set.Size(), 40000u);
+
+    {
+        auto e1 = async(launch::async, eraser);
+        auto e2 = async(launch::async, eraser);
+        auto reader = async(launch::async, [&hash_set] {
+            for (int value = 0; value < 40000; value += 2) {
+                ASSERT(hash_set.Has(value));
+            }
+        });
+        reader.get();
+    }
+    ASSERT_EQUAL(hash_set.Size(), 20000u);
+}
+
+void TestConcurrentScaling() {
+    const int value_count = 400000;
+
+    for (size_t thread_count : {1, 2, 4, 8, 16}) {
+        ConcurrentHashSet<int, IntHasher> hash_set(64);
+        {
+            LOG_DURATION(to_string(thread_count) + " threads");
+            RunConcurrentAdds(hash_set, thread_count, value_count);
+        }
+        ASSERT_EQUAL(hash_set.Size(), static_cast<size_t>(value_count));
+    }
+}
+
+string SaveImage(const FlatHashSet<int, IntHasher>& hash_set, const string& name) {
+    const string path = (filesystem::temp_directory_path() / name).string();
+
+    ofstream output(path, ios::binary);
+    hash_set.Save(output);
+
+    return path;
+}
+
+void TestImageRoundTrip() {
+    FlatHashSet<int, IntHasher> hash_set;
+    for (int value = -1000; value < 1000; ++value) {
+        hash_set.Add(value);
+    }
+    for (int value = -1000; value < 1000; value += 3) {
+        hash_set.Erase(value);
+    }
+
+    const string path = SaveImage(hash_set, "hash_set_round_trip.bin");
+    {
+        const FlatHashSetImage<int, IntHasher> image(path);
+        ASSERT_EQUAL(image.Size(), hash_set.Size());
+        for (int value = -2000; value < 2000; ++value) {
+            ASSERT_EQUAL(image.Has(value), hash_set.Has(value));
+        }
+    }
+    filesystem::remove(path);
+}
+
+void TestImageRejectsMismatch() {
+    FlatHashSet<int, IntHasher> hash_set;
+    hash_set.Add(1);
+
+    const string path = SaveImage(hash_set, "hash_set_mismatch.bin");
+    try {
+        FlatHashSetImage<int64_t, IntHasher> image(path);
+        ASSERT(false);
+    } catch (invalid_argument&) {
+    }
+
+    filesystem::resize_file(path, filesystem::file_size(path) - 1);
+    try {
+        FlatHashSetImage<int, IntHasher> image(path);
+        ASSERT(false);
+    } catch (invalid_argument&) {
+    }
+
+    // group_count * 16 wraps to 0, which would match a header-only file
+    {
+        const FlatHashSetImageHeader header{kFlatHashSetImageMagic, sizeof(int), uint64_t{1} << 60, 0};
+        ofstream output(path, ios::binary | ios::trunc);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    try {
+        FlatHashSetImage<int, IntHasher> image(path);
+        ASSERT(false);
+    } catch (invalid_argument&) {
+    }
+    filesystem::remove(path);
+
+    ofstream unopened;
+    try {
+        hash_set.Save(unopened);
+        ASSERT(false);
+    } catch (runtime_error&) {
+    }
+}
+
+void TestImageLoadSpeed() {
+    const int value_count = 1000000;
+
+    vector<int> values(value_count);
+    iota(values.begin(), values.end(), 0);
+    shuffle(values.begin(), values.end(), default_random_engine(3));
+
+    FlatHashSet<int, IntHasher> hash_set(value_count);
+    {
+        LOG_DURATION("Rebuild");
+        for (int value : values) {
+            hash_set.Add(value);
+        }
+    }
+    const string path = SaveImage(hash_set, "hash_set_load_speed.bin");
+
+    {
+        LOG_DURATION("Open image");
+        const FlatHashSetImage<int, IntHasher> image(path);
+        ASSERT(image.Has(values.front()));
+        ASSERT_EQUAL(image.Size(), values.size());
+    }
+    filesystem::remove(path);
+}
+
 int main() {
     TestRunner tr;
     RUN_TEST(tr, TestSmoke);
     RUN_TEST(tr, TestEmpty);
     RUN_TEST(tr, TestIdempotency);
     RUN_TEST(tr, TestEquivalence);
+    RUN_TEST(tr, TestRehash);
+    RUN_TEST(tr, TestReserve);
+    RUN_TEST(tr, TestMaxLoadFactor);
+    RUN_TEST(tr, TestMixedAddErase);
+    RUN_TEST(tr, TestFlatSmoke);
+    RUN_TEST(tr, TestFlatEquivalence);
+    RUN_TEST(tr, TestFlatMixedAddErase);
+    RUN_TEST(tr, TestLookupSpeed);
+    RUN_TEST(tr, TestBuildFrom);
+    RUN_TEST(tr, TestHasMany);
+    RUN_TEST(tr, TestBulkSpeed);
+    RUN_TEST(tr, TestStatefulHasher);
+    RUN_TEST(tr, TestSeededHasherSpread);
+    RUN_TEST(tr, TestHasherStorageSpeed);
+    RUN_TEST(tr, TestConcurrentAdd);
+    RUN_TEST(tr, TestConcurrentAddAndErase);
+    RUN_TEST(tr, TestConcurrentScaling);
+    RUN_TEST(tr, TestImageRoundTrip);
+    RUN_TEST(tr, TestImageRejectsMismatch);
+    RUN_TEST(tr, TestImageLoadSpeed);
     return 0;
 }
\ No newline at end of file
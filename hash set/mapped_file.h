@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+class MappedFile {
+public:
+    explicit MappedFile(const string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* Data() const;
+
+    size_t Size() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
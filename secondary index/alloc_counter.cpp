@@ -0,0 +1,59 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+namespace {
+    constexpr size_t kHeaderSize = alignof(max_align_t);
+
+    atomic<size_t> live_bytes{0};
+    atomic<size_t> allocation_count{0};
+}
+
+size_t LiveHeapBytes() {
+    return live_bytes;
+}
+
+size_t AllocationCount() {
+    return allocation_count;
+}
+
+void* operator new(size_t size) {
+    auto* block = static_cast<char*>(malloc(size + kHeaderSize));
+    if (block == nullptr)
+        throw bad_alloc();
+
+    *reinterpret_cast<size_t*>(block) = size;
+    live_bytes += size;
+    ++allocation_count;
+
+    return block + kHeaderSize;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr == nullptr)
+        return;
+
+    char* block = static_cast<char*>(ptr) - kHeaderSize;
+    live_bytes -= *reinterpret_cast<size_t*>(block);
+    free(block);
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void* ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
@@ -0,0 +1,199 @@
+#include "database.h"
+
+DatabaseSnapshot::DatabaseSnapshot(const RecordIndexes& indexes, shared_ptr<RetiredRecords> retired)
+    : RecordIndexes(indexes)
+    , retired_(move(retired)) {
+}
+
+bool Database::Put(const Record& record) {
+    if (storage.count(record.id) > 0)
+        return false;
+
+    Record* stored = AllocateRecord(record);
+    const Data data{stored, next_seq++};
+    const StringInterner::Handle user = users->Intern(record.user);
+    storage.emplace(stored->id, data);
+
+    timestamp_index.Insert(stored->timestamp, data.seq, stored);
+    karma_index.Insert(stored->karma, data.seq, stored);
+    user_timestamp_index.Insert({user, stored->timestamp}, data.seq, stored);
+    UpdateUserTotal(user, stored->karma, 1);
+
+    return true;
+}
+
+const Record* Database::GetById(string_view id) const {
+    auto it = storage.find(id);
+
+    if (it == storage.end())
+        return nullptr;
+
+    return it->second.record;
+}
+
+bool Database::Erase(string_view id) {
+    auto it = storage.find(id);
+
+    if (it == storage.end())
+        return false;
+
+    const Data data = it->second;
+    const StringInterner::Handle user = UserOf(data);
+    timestamp_index.Erase(data.record->timestamp, data.seq);
+    karma_index.Erase(data.record->karma, data.seq);
+    user_timestamp_index.Erase({user, data.record->timestamp}, data.seq);
+    UpdateUserTotal(user, -data.record->karma, -1);
+
+    storage.erase(it);
+    ReleaseRecord(data.record);
+
+    return true;
+}
+
+size_t Database::PutBatch(const vector<Record>& records) {
+    IndexEntries entries = StoreBatch(records);
+    const size_t stored_count = entries.timestamp.size();
+
+    unordered_map<StringInterner::Handle, UserTotal> deltas;
+    for (const auto& entry : entries.user_timestamp) {
+        deltas[entry.key.first].karma += entry.value->karma;
+        ++deltas[entry.key.first].record_count;
+    }
+
+    timestamp_index.InsertBatch(move(entries.timestamp));
+    karma_index.InsertBatch(move(entries.karma));
+    user_timestamp_index.InsertBatch(move(entries.user_timestamp));
+    for (const auto& [user, delta] : deltas) {
+        UpdateUserTotal(user, delta.karma, delta.record_count);
+    }
+
+    return stored_count;
+}
+
+size_t Database::BulkLoad(const vector<Record>& records) {
+    if (retired) {
+        for (const auto& [id, data] : storage) {
+            retired->Add(data.record);
+        }
+    } else {
+        lock_guard<mutex> lock(pool->guard);
+        pool->arena.Clear();
+    }
+
+    storage.clear();
+    timestamp_index.Clear();
+    karma_index.Clear();
+    user_timestamp_index.Clear();
+    user_karma_index.Clear();
+    user_totals.clear();
+
+    return PutBatch(records);
+}
+
+size_t Database::EraseBatch(const vector<string>& ids) {
+    vector<pair<int, uint64_t>> timestamp_keys;
+    vector<pair<int, uint64_t>> karma_keys;
+    vector<pair<UserTimestamp, uint64_t>> user_timestamp_keys;
+    vector<Record*> erased;
+    unordered_map<StringInterner::Handle, UserTotal> deltas;
+
+    for (const string& id : ids) {
+        auto it = storage.find(id);
+
+        if (it == storage.end())
+            continue;
+
+        const Data data = it->second;
+        const StringInterner::Handle user = UserOf(data);
+        timestamp_keys.push_back({data.record->timestamp, data.seq});
+        karma_keys.push_back({data.record->karma, data.seq});
+        user_timestamp_keys.push_back({{user, data.record->timestamp}, data.seq});
+        deltas[user].karma -= data.record->karma;
+        --deltas[user].record_count;
+
+        storage.erase(it);
+        erased.push_back(data.record);
+    }
+
+    timestamp_index.EraseBatch(move(timestamp_keys));
+    karma_index.EraseBatch(move(karma_keys));
+    user_timestamp_index.EraseBatch(move(user_timestamp_keys));
+    for (const auto& [user, delta] : deltas) {
+        UpdateUserTotal(user, delta.karma, delta.record_count);
+    }
+
+    for (Record* record : erased) {
+        ReleaseRecord(record);
+    }
+
+    return erased.size();
+}
+
+Database::IndexEntries Database::StoreBatch(const vector<Record>& records) {
+    IndexEntries entries;
+    entries.timestamp.reserve(records.size());
+    entries.karma.reserve(records.size());
+    entries.user_timestamp.reserve(records.size());
+    storage.reserve(storage.size() + records.size());
+
+    for (const Record& record : records) {
+        if (storage.count(record.id) > 0)
+            continue;
+
+        Record* stored = AllocateRecord(record);
+        const Data data{stored, next_seq++};
+        const StringInterner::Handle user = users->Intern(record.user);
+        storage.emplace(stored->id, data);
+
+        entries.timestamp.push_back({stored->timestamp, data.seq, stored});
+        entries.karma.push_back({stored->karma, data.seq, stored});
+        entries.user_timestamp.push_back({{user, stored->timestamp}, data.seq, stored});
+    }
+
+    return entries;
+}
+
+StringInterner::Handle Database::UserOf(const Data& data) const {
+    return *users->Find(data.record->user);
+}
+
+void Database::UpdateUserTotal(StringInterner::Handle user, int64_t karma_delta, int64_t count_delta) {
+    UserTotal& total = user_totals[user];
+    if (total.record_count > 0)
+        user_karma_index.Erase(total.karma, user);
+
+    total.karma += karma_delta;
+    total.record_count += count_delta;
+
+    if (total.record_count > 0)
+        user_karma_index.Insert(total.karma, user, {user, total.karma});
+    else
+        user_totals.erase(user);
+}
+
+void Database::Publish() {
+    auto next_retired = make_shared<RetiredRecords>(pool);
+    if (retired)
+        retired->SetNext(next_retired);
+    retired = move(next_retired);
+
+    atomic_store(&published, shared_ptr<const DatabaseSnapshot>(make_shared<DatabaseSnapshot>(*this, retired)));
+}
+
+shared_ptr<const DatabaseSnapshot> Database::LatestSnapshot() const {
+    return atomic_load(&published);
+}
+
+Record* Database::AllocateRecord(const Record& record) {
+    lock_guard<mutex> lock(pool->guard);
+    return pool->arena.Allocate(record);
+}
+
+void Database::ReleaseRecord(Record* record) {
+    if (retired) {
+        retired->Add(record);
+    } else {
+        lock_guard<mutex> lock(pool->guard);
+        pool->arena.Free(record);
+    }
+}
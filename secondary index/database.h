@@ -0,0 +1,90 @@
+#pragma once
+
+#include "record.h"
+#include "record_indexes.h"
+#include "retired_records.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class DatabaseSnapshot : public RecordIndexes {
+public:
+    DatabaseSnapshot(const RecordIndexes& indexes, shared_ptr<RetiredRecords> retired);
+
+private:
+    shared_ptr<RetiredRecords> retired_;
+};
+
+// Writes and GetById belong to a single writer thread. Other threads query
+// the snapshot returned by LatestSnapshot, which the writer refreshes with Publish.
+// Not copyable: records live in a shared pool and the indexes view their strings, so a copy would
+// dangle as soon as the original erased a record.
+class Database : public RecordIndexes {
+public:
+    Database() = default;
+
+    Database(const Database&) = delete;
+    Database& operator=(const Database&) = delete;
+
+    Database(Database&&) = default;
+    Database& operator=(Database&&) = default;
+
+    bool Put(const Record& record);
+
+    const Record* GetById(string_view id) const;
+
+    bool Erase(string_view id);
+
+    size_t PutBatch(const vector<Record>& records);
+
+    size_t BulkLoad(const vector<Record>& records);
+
+    size_t EraseBatch(const vector<string>& ids);
+
+    void Publish();
+
+    shared_ptr<const DatabaseSnapshot> LatestSnapshot() const;
+
+private:
+    struct Data {
+        Record* record;
+        uint64_t seq;
+    };
+
+    using Id = string_view;
+
+    struct IndexEntries {
+        vector<TimestampIndex::Entry> timestamp;
+        vector<Index<int>::Entry> karma;
+        vector<Index<UserTimestamp>::Entry> user_timestamp;
+    };
+
+    struct UserTotal {
+        int64_t karma = 0;
+        int64_t record_count = 0;
+    };
+
+    IndexEntries StoreBatch(const vector<Record>& records);
+
+    // Stored records always have an interned user; looking it up keeps Data at two words
+    StringInterner::Handle UserOf(const Data& data) const;
+
+    void UpdateUserTotal(StringInterner::Handle user, int64_t karma_delta, int64_t count_delta);
+
+    Record* AllocateRecord(const Record& record);
+
+    void ReleaseRecord(Record* record);
+
+    shared_ptr<RecordPool> pool = make_shared<RecordPool>();
+    shared_ptr<RetiredRecords> retired;
+    shared_ptr<const DatabaseSnapshot> published;
+    unordered_map<Id, Data> storage;
+    unordered_map<StringInterner::Handle, UserTotal> user_totals;
+    uint64_t next_seq = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+class FenwickTree {
+public:
+    void Assign(const vector<int64_t>& values) {
+        tree_.assign(values.size() + 1, 0);
+
+        for (size_t i = 1; i <= values.size(); ++i) {
+            tree_[i] += values[i - 1];
+            if (const size_t parent = i + (i & -i); parent <= values.size())
+                tree_[parent] += tree_[i];
+        }
+    }
+
+    void Add(size_t index, int64_t delta) {
+        for (size_t i = index + 1; i < tree_.size(); i += i & -i) {
+            tree_[i] += delta;
+        }
+    }
+
+    int64_t Prefix(size_t count) const {
+        int64_t sum = 0;
+        for (size_t i = count; i > 0; i -= i & -i) {
+            sum += tree_[i];
+        }
+        return sum;
+    }
+
+    // Smallest index whose inclusive prefix exceeds target; values must be non-negative
+    size_t FindPrefixAbove(int64_t target) const {
+        size_t step = 1;
+        while (step * 2 < tree_.size())
+            step *= 2;
+
+        size_t position = 0;
+        for (; step > 0; step /= 2) {
+            if (position + step < tree_.size() && tree_[position + step] <= target) {
+                position += step;
+                target -= tree_[position];
+            }
+        }
+
+        return position;
+    }
+
+private:
+    vector<int64_t> tree_;
+};
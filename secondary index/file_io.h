@@ -0,0 +1,11 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+optional<string> ReadFile(const string& path);
+
+void WriteAll(int fd, string_view data);
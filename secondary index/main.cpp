@@ -1,164 +1,1164 @@
+#include "alloc_counter.h"
+#include "database.h"
+#include "partitioned_database.h"
+#include "persistent_database.h"
 #include "test_runner.h"
+#include "profile.h"
+#include "sorted_index.h"
 
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <string>
-#include <tuple>
+
+#include <sys/resource.h>
 
 using namespace std;
 
-struct Record {
-    string id;
-    string title;
-    string user;
-    int timestamp;
-    int karma;
-};
+void TestRangeBoundaries() {
+    const int good_karma = 1000;
+    const int bad_karma = -10;
+
+    Database db;
+    db.Put({"id1", "Hello there", "master", 1536107260, good_karma});
+    db.Put({"id2", "O>>-<", "general2", 1536107260, bad_karma});
+
+    int count = 0;
+    db.RangeByKarma(bad_karma, good_karma, [&count](const Record&) {
+        ++count;
+        return true;
+    });
+
+    ASSERT_EQUAL(2, count);
+}
+
+void TestSameUser() {
+    Database db;
+    db.Put({"id1", "Don't sell", "master", 1536107260, 1000});
+    db.Put({"id2", "Rethink life", "master", 1536107260, 2000});
+
+    int count = 0;
+    db.AllByUser("master", [&count](const Record&) {
+        ++count;
+        return true;
+    });
 
-bool operator<(const Record& lhs, const Record& rhs) {
-    return tie(lhs.id, lhs.title, lhs.user, lhs.timestamp, lhs.karma)
-        < tie(rhs.id, rhs.title, rhs.user, rhs.timestamp, rhs.karma);
+    ASSERT_EQUAL(2, count);
 }
 
-class Database {
-public:
-    bool Put(const Record& record) {
-        auto [it, success] = storage.insert({record.id, {record, {}, {}, {}}});
+void TestReplacement() {
+    const string final_body = "Feeling sad";
+
+    Database db;
+    db.Put({"id", "Have a hand", "not-master", 1536107260, 10});
+    db.Erase("id");
+    db.Put({"id", final_body, "not-master", 1536107260, -10});
 
-        if (!success)
-            return false;
+    auto record = db.GetById("id");
+    ASSERT(record != nullptr);
+    ASSERT_EQUAL(final_body, record->title);
+}
 
-        auto& data = it->second;
-        const Record* record_ptr = &data.record;
+void TestSortedIndexBlocks() {
+    SortedIndex<int, int> index;
+    map<pair<int, uint64_t>, int> expected;
 
-        data.timestamp_iter = timestamp_index.insert({record.timestamp, record_ptr});
-        data.karma_iter = karma_index.insert({record.karma, record_ptr});
-        data.user_iter = user_index.insert({record.user, record_ptr});
+    default_random_engine engine(11);
+    uniform_int_distribution<int> key_dist(0, 500);
 
-        return true;
+    for (uint64_t seq = 0; seq < 5000; ++seq) {
+        const int key = key_dist(engine);
+        index.Insert(key, seq, static_cast<int>(seq));
+        expected[{key, seq}] = static_cast<int>(seq);
+    }
+    for (uint64_t seq = 0; seq < 5000; seq += 3) {
+        auto it = find_if(expected.begin(), expected.end(), [seq](const auto& item) {
+            return item.first.second == seq;
+        });
+        ASSERT(index.Erase(it->first.first, seq));
+        ASSERT(!index.Erase(it->first.first, seq));
+        expected.erase(it);
     }
+    ASSERT_EQUAL(index.Size(), expected.size());
 
-    const Record* GetById(const string& id) const {
-        if (storage.count(id) == 0)
-            return nullptr;
+    for (int low : {-1, 0, 17, 250, 499, 501}) {
+        const int high = low + 40;
 
-        return &storage.at(id).record;
+        vector<int> values;
+        index.ForEachInRange(low, high, [&values](int value) {
+            values.push_back(value);
+            return true;
+        });
+
+        vector<int> expected_values;
+        for (auto it = expected.lower_bound({low, 0}); it != expected.end() && it->first.first <= high; ++it) {
+            expected_values.push_back(it->second);
+        }
+        ASSERT_EQUAL(values, expected_values);
     }
+}
 
-    bool Erase(const string& id) {
-        auto it = storage.find(id);
+void TestEarlyStop() {
+    Database db;
+    for (int i = 0; i < 1000; ++i) {
+        db.Put({"id" + to_string(i), "title", "user", i, i});
+    }
 
-        if (it == storage.end())
-            return false;
+    int count = 0;
+    db.RangeByTimestamp(0, 999, [&count](const Record&) {
+        return ++count < 300;
+    });
 
-        timestamp_index.erase(it->second.timestamp_iter);
-        karma_index.erase(it->second.karma_iter);
-        user_index.erase(it->second.user_iter);
+    ASSERT_EQUAL(count, 300);
+}
 
-        storage.erase(it);
+vector<Record> MakeRecords(size_t count, int seed) {
+    default_random_engine engine(seed);
+    uniform_int_distribution<int> timestamp_dist(0, 1000000);
+    uniform_int_distribution<int> karma_dist(-1000, 1000);
+    uniform_int_distribution<int> user_dist(0, 10000);
 
-        return true;
+    vector<Record> records;
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        records.push_back({
+            "id" + to_string(i), "title", "user" + to_string(user_dist(engine)),
+            timestamp_dist(engine), karma_dist(engine)
+        });
     }
 
-    template <typename Callback>
-    void RangeByTimestamp(int low, int high, Callback callback) const {
-        auto start_it = timestamp_index.lower_bound(low);
-        auto end_it = timestamp_index.upper_bound(high);
+    return records;
+}
 
-        while (start_it != timestamp_index.end() && start_it != end_it) {
-            if (!callback(*start_it->second))
-                break;
+void TestIndexSpeed() {
+    const vector<Record> records = MakeRecords(200000, 5);
 
-            ++start_it;
+    multimap<int, const Record*> timestamp_multimap;
+    multimap<int, const Record*> karma_multimap;
+    multimap<string, const Record*> user_multimap;
+    {
+        LOG_DURATION("Multimap insert");
+        for (const Record& record : records) {
+            timestamp_multimap.insert({record.timestamp, &record});
+            karma_multimap.insert({record.karma, &record});
+            user_multimap.insert({record.user, &record});
         }
     }
 
-    template <typename Callback>
-    void RangeByKarma(int low, int high, Callback callback) const {
-        auto start_it = karma_index.lower_bound(low);
-        auto end_it = karma_index.upper_bound(high);
+    SortedIndex<int, const Record*> timestamp_index;
+    SortedIndex<int, const Record*> karma_index;
+    SortedIndex<string, const Record*> user_index;
+    {
+        LOG_DURATION("Sorted index insert");
+        for (size_t i = 0; i < records.size(); ++i) {
+            timestamp_index.Insert(records[i].timestamp, i, &records[i]);
+            karma_index.Insert(records[i].karma, i, &records[i]);
+            user_index.Insert(records[i].user, i, &records[i]);
+        }
+    }
 
-        while (start_it != karma_index.end() && start_it != end_it) {
-            if (!callback(*start_it->second))
-                break;
+    int multimap_karma = 0;
+    {
+        LOG_DURATION("Multimap range scan");
+        for (int low = 0; low < 1000000; low += 1000) {
+            auto end_it = timestamp_multimap.upper_bound(low + 50000);
+            for (auto it = timestamp_multimap.lower_bound(low); it != end_it; ++it) {
+                multimap_karma += it->second->karma;
+            }
+        }
+    }
 
-            ++start_it;
+    int index_karma = 0;
+    {
+        LOG_DURATION("Sorted index range scan");
+        for (int low = 0; low < 1000000; low += 1000) {
+            timestamp_index.ForEachInRange(low, low + 50000, [&index_karma](const Record* record) {
+                index_karma += record->karma;
+                return true;
+            });
         }
     }
+    ASSERT_EQUAL(multimap_karma, index_karma);
 
-    template <typename Callback>
-    void AllByUser(const string& user, Callback callback) const {
-        auto [start_it, end_it] = user_index.equal_range(user);
+    {
+        LOG_DURATION("Sorted index erase");
+        for (size_t i = 0; i < records.size(); i += 2) {
+            timestamp_index.Erase(records[i].timestamp, i);
+            karma_index.Erase(records[i].karma, i);
+            user_index.Erase(records[i].user, i);
+        }
+    }
+    ASSERT_EQUAL(timestamp_index.Size(), records.size() / 2);
+}
 
-        while (start_it != user_index.end() && start_it != end_it) {
-            if (!callback(*start_it->second))
-                break;
+void TestArenaReuse() {
+    Database db;
+    for (int i = 0; i < 3000; ++i) {
+        ASSERT(db.Put({"id" + to_string(i), "title", "user" + to_string(i % 7), i, i}));
+    }
+    for (int i = 0; i < 3000; i += 2) {
+        ASSERT(db.Erase("id" + to_string(i)));
+    }
+    for (int i = 0; i < 3000; i += 2) {
+        ASSERT(db.Put({"id" + to_string(i), "new title", "user" + to_string(i % 7), i, -i}));
+    }
 
-            ++start_it;
-        }
+    for (int i = 0; i < 3000; ++i) {
+        const Record* record = db.GetById("id" + to_string(i));
+        ASSERT(record != nullptr);
+        ASSERT_EQUAL(record->id, "id" + to_string(i));
+        ASSERT_EQUAL(record->title, i % 2 == 0 ? "new title" : "title");
+        ASSERT_EQUAL(record->user, "user" + to_string(i % 7));
     }
 
-private:
-    template <typename Type>
-    using Index = multimap<Type, const Record*>;
+    int count = 0;
+    db.AllByUser("user3", [&count](const Record& record) {
+        ASSERT_EQUAL(record.user, "user3");
+        ++count;
+        return true;
+    });
+    ASSERT_EQUAL(count, 3000 / 7 + 1);
 
-    struct Data {
-        Record record;
-        Index<int>::iterator timestamp_iter;
-        Index<int>::iterator karma_iter;
-        Index<string>::iterator user_iter;
-    };
+    db.AllByUser("nobody", [](const Record&) {
+        ASSERT(false);
+        return true;
+    });
+}
 
-    using Id = string;
+void TestDatabaseMove() {
+    static_assert(!is_copy_constructible_v<Database> && !is_copy_assignable_v<Database>);
 
-    unordered_map<Id, Data> storage;
-    Index<int> timestamp_index;
-    Index<int> karma_index;
-    Index<string> user_index;
-};
+    Database source;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT(source.Put({"id" + to_string(i), "title", "user" + to_string(i % 3), i, i}));
+    }
 
-void TestRangeBoundaries() {
-    const int good_karma = 1000;
-    const int bad_karma = -10;
+    Database moved(move(source));
+    ASSERT(moved.Erase("id0"));
+    ASSERT(moved.GetById("id0") == nullptr);
+    ASSERT_EQUAL(moved.GetById("id1")->title, "title");
 
-    Database db;
-    db.Put({"id1", "Hello there", "master", 1536107260, good_karma});
-    db.Put({"id2", "O>>-<", "general2", 1536107260, bad_karma});
+    Database assigned;
+    assigned.Put({"other", "title", "user", 0, 0});
+    assigned = move(moved);
+    ASSERT(assigned.GetById("other") == nullptr);
+    ASSERT(assigned.Put({"id0", "again", "user0", 0, 0}));
 
     int count = 0;
-    db.RangeByKarma(bad_karma, good_karma, [&count](const Record&) {
+    assigned.AllByUser("user1", [&count](const Record&) {
         ++count;
         return true;
     });
+    ASSERT_EQUAL(count, 33);
+}
 
-    ASSERT_EQUAL(2, count);
+void TestMemoryPerRecord() {
+    const vector<Record> records = MakeRecords(200000, 9);
+
+    size_t multimap_bytes = 0;
+    {
+        const size_t bytes_before = LiveHeapBytes();
+
+        unordered_map<string, Record> storage;
+        multimap<int, const Record*> timestamp_index;
+        multimap<int, const Record*> karma_index;
+        multimap<string, const Record*> user_index;
+        for (const Record& record : records) {
+            const Record* stored = &storage.insert({record.id, record}).first->second;
+            timestamp_index.insert({record.timestamp, stored});
+            karma_index.insert({record.karma, stored});
+            user_index.insert({record.user, stored});
+        }
+
+        multimap_bytes = LiveHeapBytes() - bytes_before;
+    }
+
+    const size_t bytes_before = LiveHeapBytes();
+    const size_t allocations_before = AllocationCount();
+
+    Database db;
+    for (const Record& record : records) {
+        db.Put(record);
+    }
+
+    const size_t database_bytes = LiveHeapBytes() - bytes_before;
+    const size_t allocations = AllocationCount() - allocations_before;
+
+    cerr << "Bytes per record: multimap layout " << multimap_bytes / records.size()
+         << ", database " << database_bytes / records.size()
+         << ", allocations per Put " << static_cast<double>(allocations) / records.size() << endl;
+
+    // 283 against 334 bytes at the time of writing; keep at least a 10% saving
+    ASSERT(database_bytes * 10 < multimap_bytes * 9);
 }
 
-void TestSameUser() {
+void TestBatchOperations() {
+    const vector<Record> records = MakeRecords(5000, 13);
+
+    Database one_by_one;
+    for (const Record& record : records) {
+        one_by_one.Put(record);
+    }
+
+    Database batched;
+    ASSERT_EQUAL(batched.PutBatch({records.begin(), records.begin() + 100}), 100u);
+    ASSERT_EQUAL(batched.PutBatch(records), records.size() - 100);
+    ASSERT_EQUAL(batched.PutBatch({{"id7", "dup", "user", 0, 0}}), 0u);
+
+    Database loaded;
+    loaded.Put({"stale", "title", "user", 5, 5});
+    ASSERT_EQUAL(loaded.BulkLoad(records), records.size());
+    ASSERT(loaded.GetById("stale") == nullptr);
+
+    vector<string> ids;
+    for (size_t i = 0; i < records.size(); i += 3) {
+        ids.push_back(records[i].id);
+        one_by_one.Erase(records[i].id);
+    }
+    ids.push_back("missing");
+    ASSERT_EQUAL(batched.EraseBatch(ids), records.size() / 3 + 1);
+    ASSERT_EQUAL(loaded.EraseBatch({ids.begin(), ids.begin() + 10}), 10u);
+    for (size_t i = 10; i < ids.size(); ++i) {
+        loaded.Erase(ids[i]);
+    }
+
+    auto collect = [](const Database& db, int low, int high) {
+        vector<string> ids;
+        db.RangeByKarma(low, high, [&ids](const Record& record) {
+            ids.push_back(record.id);
+            return true;
+        });
+        return ids;
+    };
+
+    for (int low : {-1000, -10, 500}) {
+        const auto expected = collect(one_by_one, low, low + 300);
+        ASSERT_EQUAL(collect(batched, low, low + 300), expected);
+        ASSERT_EQUAL(collect(loaded, low, low + 300), expected);
+    }
+}
+
+void TestBulkLoadSpeed() {
+    const vector<Record> records = MakeRecords(200000, 17);
+
+    {
+        Database db;
+        LOG_DURATION("Put one by one");
+        for (const Record& record : records) {
+            db.Put(record);
+        }
+    }
+    {
+        Database db;
+        LOG_DURATION("BulkLoad");
+        db.BulkLoad(records);
+    }
+}
+
+void TestCompositeQueries() {
+    const vector<Record> records = MakeRecords(20000, 19);
+
     Database db;
-    db.Put({"id1", "Don't sell", "master", 1536107260, 1000});
-    db.Put({"id2", "Rethink life", "master", 1536107260, 2000});
+    db.PutBatch(records);
+    for (size_t i = 0; i < records.size(); i += 5) {
+        db.Erase(records[i].id);
+    }
 
-    int count = 0;
-    db.AllByUser("master", [&count](const Record&) {
-        ++count;
+    auto collect_ids = [](auto query) {
+        set<string> ids;
+        query([&ids](const Record& record) {
+            ids.insert(record.id);
+            return true;
+        });
+        return ids;
+    };
+
+    for (const char* user : {"user1", "user42", "user9999", "nobody"}) {
+        const auto expected = collect_ids([&](auto callback) {
+            db.AllByUser(user, [&](const Record& record) {
+                return record.timestamp < 200000 || record.timestamp > 700000 || callback(record);
+            });
+        });
+        const auto actual = collect_ids([&](auto callback) {
+            db.RangeByUserAndTimestamp(user, 200000, 700000, callback);
+        });
+        ASSERT_EQUAL(actual, expected);
+    }
+
+    for (auto [karma_low, karma_high, timestamp_low, timestamp_high] : {
+            tuple{-1000, 1000, 0, 1000000},
+            tuple{10, 20, 0, 1000000},
+            tuple{-1000, 1000, 5000, 6000},
+            tuple{-50, 50, 300000, 400000},
+            tuple{50, -50, 0, 1000000}
+    }) {
+        const auto expected = collect_ids([&](auto callback) {
+            db.RangeByTimestamp(timestamp_low, timestamp_high, [&](const Record& record) {
+                return record.karma < karma_low || record.karma > karma_high || callback(record);
+            });
+        });
+        const auto actual = collect_ids([&](auto callback) {
+            db.RangeByKarmaAndTimestamp(karma_low, karma_high, timestamp_low, timestamp_high, callback);
+        });
+        ASSERT_EQUAL(actual, expected);
+    }
+}
+
+void TestIndexCount() {
+    SortedIndex<int, int> index;
+    for (int i = 0; i < 10000; ++i) {
+        index.Insert(i / 10, i, i);
+    }
+
+    ASSERT_EQUAL(index.Count(5, 5), 10u);
+    ASSERT_EQUAL(index.Count(7, 3), 0u);
+    ASSERT_EQUAL(index.Count(2000, 3000), 0u);
+    ASSERT_EQUAL(index.Count(100, 899), 8000u);
+    ASSERT_EQUAL(index.Rank(100), 1000u);
+    ASSERT_EQUAL(*index.KeyAtRank(4321), 432);
+    ASSERT(!index.KeyAtRank(10000));
+}
+
+void TestSelectiveQuerySpeed() {
+    Database db;
+    db.BulkLoad(MakeRecords(200000, 23));
+
+    size_t filtered_count = 0;
+    {
+        LOG_DURATION("User and timestamp via callback filter");
+        for (int user = 0; user < 10000; user += 10) {
+            db.AllByUser("user" + to_string(user), [&filtered_count](const Record& record) {
+                filtered_count += record.timestamp >= 400000 && record.timestamp <= 410000;
+                return true;
+            });
+        }
+    }
+
+    size_t composite_count = 0;
+    {
+        LOG_DURATION("User and timestamp via composite index");
+        for (int user = 0; user < 10000; user += 10) {
+            db.RangeByUserAndTimestamp("user" + to_string(user), 400000, 410000,
+                                       [&composite_count](const Record&) {
+                                           ++composite_count;
+                                           return true;
+                                       });
+        }
+    }
+    ASSERT_EQUAL(composite_count, filtered_count);
+
+    filtered_count = 0;
+    {
+        LOG_DURATION("Karma and timestamp via callback filter");
+        for (int karma = -1000; karma < 1000; karma += 20) {
+            db.RangeByTimestamp(0, 1000000, [&filtered_count, karma](const Record& record) {
+                filtered_count += record.karma == karma;
+                return true;
+            });
+        }
+    }
+
+    size_t combined_count = 0;
+    {
+        LOG_DURATION("Karma and timestamp via selective index");
+        for (int karma = -1000; karma < 1000; karma += 20) {
+            db.RangeByKarmaAndTimestamp(karma, karma, 0, 1000000, [&combined_count](const Record&) {
+                ++combined_count;
+                return true;
+            });
+        }
+    }
+    ASSERT_EQUAL(combined_count, filtered_count);
+}
+
+void TestSnapshotIsolation() {
+    Database db;
+    db.Put({"id1", "first", "master", 10, 1});
+    db.Put({"id2", "second", "master", 20, 2});
+    db.Publish();
+
+    const auto old_snapshot = db.LatestSnapshot();
+
+    db.Erase("id1");
+    db.Put({"id3", "third", "master", 30, 3});
+    for (int i = 0; i < 2000; ++i) {
+        db.Put({"tmp" + to_string(i), "tmp", "other", i, i});
+    }
+    db.Publish();
+
+    const auto new_snapshot = db.LatestSnapshot();
+
+    auto collect_titles = [](const DatabaseSnapshot& snapshot) {
+        vector<string> titles;
+        snapshot.AllByUser("master", [&titles](const Record& record) {
+            titles.push_back(record.title);
+            return true;
+        });
+        return titles;
+    };
+
+    ASSERT_EQUAL(collect_titles(*old_snapshot), vector<string>({"first", "second"}));
+    ASSERT_EQUAL(collect_titles(*new_snapshot), vector<string>({"second", "third"}));
+
+    int old_count = 0;
+    old_snapshot->RangeByTimestamp(0, 5000, [&old_count](const Record&) {
+        ++old_count;
         return true;
     });
+    ASSERT_EQUAL(old_count, 2);
 
-    ASSERT_EQUAL(2, count);
+    db.BulkLoad({{"id9", "ninth", "master", 90, 9}});
+    ASSERT_EQUAL(collect_titles(*new_snapshot), vector<string>({"second", "third"}));
+    ASSERT_EQUAL(collect_titles(*db.LatestSnapshot()), vector<string>({"second", "third"}));
+    db.Publish();
+    ASSERT_EQUAL(collect_titles(*db.LatestSnapshot()), vector<string>({"ninth"}));
 }
 
-void TestReplacement() {
-    const string final_body = "Feeling sad";
+size_t RunSnapshotReaders(Database& db, size_t reader_count, int write_count, int live_count) {
+    atomic<bool> writer_done = false;
+    auto writer = async(launch::async, [&db, &writer_done, write_count, live_count] {
+        for (int i = 0; i < write_count; ++i) {
+            const string id = "id" + to_string(i + live_count);
+            db.Put({id, id, "user" + to_string(i % 100), i % 100000, i % 1000});
+            db.Erase("id" + to_string(i));
+            if (i % 64 == 0)
+                db.Publish();
+        }
+        writer_done = true;
+    });
+
+    vector<future<size_t>> readers;
+    for (size_t i = 0; i < reader_count; ++i) {
+        readers.push_back(async(launch::async, [&db, &writer_done, live_count] {
+            size_t query_count = 0;
+            while (!writer_done) {
+                const auto snapshot = db.LatestSnapshot();
+
+                int count = 0;
+                snapshot->RangeByTimestamp(numeric_limits<int>::min(), numeric_limits<int>::max(),
+                                           [&count](const Record& record) {
+                                               ASSERT_EQUAL(record.id, record.title);
+                                               ++count;
+                                               return true;
+                                           });
+                ASSERT_EQUAL(count, live_count);
+                ++query_count;
+            }
+            return query_count;
+        }));
+    }
+
+    writer.get();
+
+    size_t total_queries = 0;
+    for (auto& reader : readers) {
+        total_queries += reader.get();
+    }
+    return total_queries;
+}
+
+void TestConcurrentSnapshots() {
+    const int live_count = 2000;
+
+    for (size_t reader_count : {1, 2, 4, 8}) {
+        Database db;
+        for (int i = 0; i < live_count; ++i) {
+            const string id = "id" + to_string(i);
+            db.Put({id, id, "user", i, i});
+        }
+        db.Publish();
+
+        size_t query_count = 0;
+        {
+            LOG_DURATION(to_string(reader_count) + " readers with a writer");
+            query_count = RunSnapshotReaders(db, reader_count, 20000, live_count);
+        }
+        cerr << "  full range scans: " << query_count << endl;
+    }
+}
+
+string MakeTempDirectory(const string& name) {
+    const auto path = filesystem::temp_directory_path() / name;
+    filesystem::remove_all(path);
+    return path.string();
+}
+
+vector<string> CollectIds(const Database& db) {
+    vector<string> ids;
+    db.RangeByTimestamp(numeric_limits<int>::min(), numeric_limits<int>::max(), [&ids](const Record& record) {
+        ids.push_back(record.id + "/" + record.title + "/" + record.user);
+        return true;
+    });
+    sort(ids.begin(), ids.end());
+    return ids;
+}
+
+void TestPersistenceRecovery() {
+    const string directory = MakeTempDirectory("secondary_index_recovery");
+    const PersistenceOptions options{16, 1000};
+
+    vector<string> expected;
+    {
+        PersistentDatabase db(directory, options);
+        for (int i = 0; i < 2500; ++i) {
+            db.Put({"id" + to_string(i), "title" + to_string(i), "user" + to_string(i % 13), i, -i});
+        }
+        for (int i = 0; i < 2500; i += 7) {
+            db.Erase("id" + to_string(i));
+        }
+        ASSERT(!db.Put({"id1", "duplicate", "user", 0, 0}));
+        expected = CollectIds(db.GetDatabase());
+    }
+    {
+        PersistentDatabase db(directory, options);
+        ASSERT_EQUAL(CollectIds(db.GetDatabase()), expected);
+
+        db.Checkpoint();
+        db.Put({"after", "checkpoint", "user", 1, 1});
+        db.Erase("id1");
+        expected = CollectIds(db.GetDatabase());
+    }
+
+    {
+        ofstream wal(filesystem::path(directory) / "wal.bin", ios::binary | ios::app);
+        wal << "torn";
+    }
+    {
+        PersistentDatabase db(directory, options);
+        ASSERT_EQUAL(CollectIds(db.GetDatabase()), expected);
+        db.Put({"after", "torn", "tail", 2, 2});
+        db.Put({"more", "after", "torn", 3, 3});
+        expected = CollectIds(db.GetDatabase());
+    }
+    {
+        PersistentDatabase db(directory, options);
+        ASSERT_EQUAL(CollectIds(db.GetDatabase()), expected);
+        db.Checkpoint();
+    }
+
+    // A record count the file can't hold is rejected before anything is allocated for it
+    {
+        fstream snapshot(filesystem::path(directory) / "snapshot.bin", ios::binary | ios::in | ios::out);
+        const uint64_t record_count = uint64_t{1} << 60;
+        snapshot.seekp(2 * sizeof(uint64_t));
+        snapshot.write(reinterpret_cast<const char*>(&record_count), sizeof(record_count));
+    }
+    try {
+        PersistentDatabase db(directory, options);
+        ASSERT(false);
+    } catch (const runtime_error&) {
+    }
+
+    filesystem::remove_all(directory);
+}
+
+void TestLogWriteFailure() {
+    const string directory = MakeTempDirectory("secondary_index_log_failure");
+    filesystem::create_directories(directory);
+    const string path = (filesystem::path(directory) / "wal.bin").string();
+
+    WriteAheadLog log(path, 1, 0, 1000);
+    log.AppendPut({"id0", "title", "user", 0, 0});
+    log.Sync();
+
+    // A file size limit makes the next write stop partway, leaving a torn entry on disk
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    const auto previous_handler = signal(SIGXFSZ, SIG_IGN);
+    rlimit limited = original;
+    limited.rlim_cur = filesystem::file_size(path) + 16;
+    setrlimit(RLIMIT_FSIZE, &limited);
+
+    log.AppendPut({"id1", string(100, 'x'), "user", 1, 1});
+    const auto throws = [](auto operation) {
+        try {
+            operation();
+        } catch (const runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+    const bool sync_failed = throws([&log] { log.Sync(); });
+
+    setrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, previous_handler);
+    ASSERT(sync_failed);
+
+    // Nothing may be written behind the torn entry, where recovery would never find it
+    ASSERT(throws([&log] { log.AppendPut({"id2", "title", "user", 2, 2}); }));
+    ASSERT(throws([&log] { log.AppendErase("id0"); }));
+    ASSERT(throws([&log] { log.Sync(); }));
+
+    const optional<LogContents> contents = ReadLog(path);
+    ASSERT(contents.has_value());
+    ASSERT_EQUAL(contents->entries.size(), 1u);
+    ASSERT_EQUAL(contents->entries[0].record.id, "id0");
+
+    filesystem::remove_all(directory);
+}
+
+void TestPersistenceSpeed() {
+    const vector<Record> records = MakeRecords(50000, 29);
+
+    for (size_t group_commit_size : {1, 128, 4096}) {
+        const string directory = MakeTempDirectory("secondary_index_speed");
+        const size_t put_count = group_commit_size == 1 ? 2000 : records.size();
+
+        PersistentDatabase db(directory, {group_commit_size, numeric_limits<size_t>::max()});
+        LOG_DURATION(to_string(put_count) + " logged Puts, fsync every " + to_string(group_commit_size));
+        for (size_t i = 0; i < put_count; ++i) {
+            db.Put(records[i]);
+        }
+        db.Sync();
+    }
+
+    const string directory = MakeTempDirectory("secondary_index_speed");
+    {
+        PersistentDatabase db(directory, {4096, numeric_limits<size_t>::max()});
+        for (const Record& record : records) {
+            db.Put(record);
+        }
+    }
+    {
+        LOG_DURATION("Recovery from log");
+        PersistentDatabase db(directory);
+        ASSERT_EQUAL(CollectIds(db.GetDatabase()).size(), records.size());
+        db.Checkpoint();
+    }
+    {
+        LOG_DURATION("Recovery from snapshot");
+        PersistentDatabase db(directory);
+        ASSERT_EQUAL(CollectIds(db.GetDatabase()).size(), records.size());
+    }
+
+    filesystem::remove_all(directory);
+}
+
+void TestAggregates() {
+    const vector<Record> records = MakeRecords(6000, 31);
 
     Database db;
-    db.Put({"id", "Have a hand", "not-master", 1536107260, 10});
-    db.Erase("id");
-    db.Put({"id", final_body, "not-master", 1536107260, -10});
+    db.PutBatch({records.begin(), records.begin() + 3000});
+    for (size_t i = 3000; i < records.size(); ++i) {
+        db.Put(records[i]);
+    }
+    for (size_t i = 0; i < records.size(); i += 4) {
+        db.Erase(records[i].id);
+    }
+    vector<string> erased_ids;
+    for (size_t i = 1; i < records.size(); i += 9) {
+        erased_ids.push_back(records[i].id);
+    }
+    db.EraseBatch(erased_ids);
+
+    vector<const Record*> live;
+    for (const Record& record : records) {
+        if (db.GetById(record.id) != nullptr)
+            live.push_back(&record);
+    }
+
+    for (auto [low, high] : {pair{0, 1000000}, pair{1000, 2000}, pair{250000, 750000}, pair{10, 5}}) {
+        size_t count = 0;
+        int64_t karma = 0;
+        for (const Record* record : live) {
+            if (record->timestamp >= low && record->timestamp <= high) {
+                ++count;
+                karma += record->karma;
+            }
+        }
+
+        ASSERT_EQUAL(db.CountByTimestamp(low, high), count);
+        ASSERT_EQUAL(db.SumKarmaByTimestamp(low, high), karma);
+    }
+
+    vector<int> karmas;
+    for (const Record* record : live) {
+        karmas.push_back(record->karma);
+    }
+    sort(karmas.begin(), karmas.end());
+    ASSERT_EQUAL(*db.KarmaPercentile(0), karmas.front());
+    ASSERT_EQUAL(*db.KarmaPercentile(50), karmas[(karmas.size() + 1) / 2 - 1]);
+    ASSERT_EQUAL(*db.KarmaPercentile(100), karmas.back());
+    ASSERT_EQUAL(db.CountByKarma(-1000, 0), static_cast<size_t>(
+            upper_bound(karmas.begin(), karmas.end(), 0) - karmas.begin()));
+
+    map<string, int64_t> user_karma;
+    for (const Record* record : live) {
+        user_karma[record->user] += record->karma;
+    }
+    vector<int64_t> expected_top;
+    for (const auto& [user, karma] : user_karma) {
+        expected_top.push_back(karma);
+    }
+    sort(expected_top.rbegin(), expected_top.rend());
+    expected_top.resize(10);
+
+    const auto top = db.TopUsersByKarma(10);
+    ASSERT_EQUAL(top.size(), 10u);
+    for (size_t i = 0; i < top.size(); ++i) {
+        ASSERT_EQUAL(top[i].second, expected_top[i]);
+        ASSERT_EQUAL(user_karma.at(top[i].first), top[i].second);
+    }
+
+    Database empty;
+    ASSERT(!empty.TimestampPercentile(50));
+    ASSERT(empty.TopUsersByKarma(5).empty());
+}
+
+void TestAggregateSpeed() {
+    Database db;
+    db.BulkLoad(MakeRecords(200000, 37));
+
+    int64_t callback_sum = 0;
+    {
+        LOG_DURATION("Karma sum via callback");
+        for (int low = 0; low < 1000000; low += 10000) {
+            db.RangeByTimestamp(low, low + 100000, [&callback_sum](const Record& record) {
+                callback_sum += record.karma;
+                return true;
+            });
+        }
+    }
+
+    int64_t aggregate_sum = 0;
+    {
+        LOG_DURATION("Karma sum via augmented index");
+        for (int low = 0; low < 1000000; low += 10000) {
+            aggregate_sum += db.SumKarmaByTimestamp(low, low + 100000);
+        }
+    }
+    ASSERT_EQUAL(aggregate_sum, callback_sum);
+}
+
+void TestColumnarScan() {
+    const vector<Record> records = MakeRecords(5003, 41);
+    Database db;
+    db.PutBatch(records);
+    for (size_t i = 0; i < records.size(); i += 3) {
+        db.Erase(records[i].id);
+    }
+
+    const RecordColumns columns = db.Columns();
+    ASSERT_EQUAL(columns.Size(), db.CountByTimestamp(0, 1000000));
+
+    for (auto [timestamp_low, timestamp_high, karma_low, karma_high] : {
+            tuple{0, 1000000, -1000, 1000}, tuple{1000, 2000, -100, 100},
+            tuple{250000, 750000, 500, 1000}, tuple{10, 5, -1000, 1000}, tuple{0, 1000000, 7, 7}}) {
+        vector<pair<int, int>> expected;
+        db.RangeByTimestamp(timestamp_low, timestamp_high, [&](const Record& record) {
+            if (record.karma >= karma_low && record.karma <= karma_high)
+                expected.push_back({record.timestamp, record.karma});
+            return true;
+        });
+
+        vector<pair<int, int>> scanned;
+        columns.ScanColumns(timestamp_low, timestamp_high, karma_low, karma_high, [&](int timestamp, int karma) {
+            scanned.push_back({timestamp, karma});
+            return true;
+        });
+
+        ASSERT(scanned == expected);
+
+        int64_t expected_sum = 0;
+        for (auto [timestamp, karma] : expected) {
+            expected_sum += karma;
+        }
+        ASSERT_EQUAL(columns.SumKarma(timestamp_low, timestamp_high, karma_low, karma_high), expected_sum);
+    }
+
+    size_t visited = 0;
+    columns.ScanColumns(0, 1000000, -1000, 1000, [&visited](int, int) {
+        return ++visited < 20;
+    });
+    ASSERT_EQUAL(visited, 20u);
+
+    db.Put({"late", "title", "user1", 500, 5});
+    ASSERT_EQUAL(columns.Size() + 1, db.Columns().Size());
+}
+
+void TestColumnarScanSpeed() {
+    Database db;
+    db.BulkLoad(MakeRecords(200000, 43));
+    const RecordColumns columns = db.Columns();
+
+    int64_t indexed_sum = 0;
+    {
+        LOG_DURATION("Filtered karma sum via RangeByTimestamp");
+        for (int low = 0; low < 1000000; low += 10000) {
+            db.RangeByTimestamp(low, low + 200000, [&indexed_sum](const Record& record) {
+                if (record.karma >= 0 && record.karma <= 500)
+                    indexed_sum += record.karma;
+                return true;
+            });
+        }
+    }
+
+    int64_t columnar_sum = 0;
+    {
+        LOG_DURATION("Filtered karma sum via ScanColumns");
+        for (int low = 0; low < 1000000; low += 10000) {
+            columnar_sum += columns.SumKarma(low, low + 200000, 0, 500);
+        }
+    }
+    ASSERT_EQUAL(columnar_sum, indexed_sum);
+}
+
+void TestStringViewLookups() {
+    Database db;
+    db.PutBatch(MakeRecords(5000, 47));
+    db.Put({"a long identifier that does not fit in the small string buffer", "title", "user3", 7, 1});
+
+    const string id_buffer = "xxid42xx";
+    const string_view id = string_view(id_buffer).substr(2, 4);
+    const char* long_id = "a long identifier that does not fit in the small string buffer";
+
+    const size_t allocations_before = AllocationCount();
+
+    const Record* record = db.GetById(id);
+    const Record* long_record = db.GetById(long_id);
+    const Record* missing = db.GetById("missing");
+
+    size_t user_records = 0;
+    db.AllByUser("user3", [&user_records](const Record&) {
+        ++user_records;
+        return true;
+    });
+    db.RangeByUserAndTimestamp(string_view("user3"), 0, 1000000, [&user_records](const Record&) {
+        ++user_records;
+        return true;
+    });
+    db.AllByUser("nobody", [](const Record&) {
+        return true;
+    });
+    const bool erased_missing = db.Erase("missing");
+
+    const size_t allocations = AllocationCount() - allocations_before;
+    ASSERT_EQUAL(allocations, 0u);
 
-    auto record = db.GetById("id");
     ASSERT(record != nullptr);
-    ASSERT_EQUAL(final_body, record->title);
+    ASSERT_EQUAL(record->id, "id42");
+    ASSERT(long_record != nullptr);
+    ASSERT_EQUAL(long_record->timestamp, 7);
+    ASSERT(missing == nullptr);
+    ASSERT(user_records > 2);
+    ASSERT(!erased_missing);
+
+    ASSERT(db.Erase(long_id));
+    ASSERT(db.GetById(long_id) == nullptr);
+    ASSERT(db.Erase(db.GetById("id7")->id));
+    ASSERT(db.GetById("id7") == nullptr);
+}
+
+void TestPageCursors() {
+    const vector<Record> records = MakeRecords(3000, 53);
+    Database db;
+    db.PutBatch(records);
+
+    vector<string> expected;
+    db.RangeByTimestamp(100000, 900000, [&expected](const Record& record) {
+        expected.push_back(record.id);
+        return true;
+    });
+
+    vector<string> paged;
+    Database::TimestampCursor cursor;
+    for (int page = 0; !cursor.Exhausted(); ++page) {
+        cursor = db.PageByTimestamp(100000, 900000, 64, cursor, [&paged](const Record& record) {
+            paged.push_back(record.id);
+            return true;
+        });
+
+        db.Put({"new" + to_string(page), "title", "user1", 50000, 1});
+        db.Put({"tail" + to_string(page), "title", "user1", 950000, 1});
+        if (page % 3 == 0 && page * 64 < static_cast<int>(expected.size()))
+            db.Erase(expected[page * 64]);
+    }
+
+    ASSERT_EQUAL(paged, expected);
+
+    size_t karma_records = 0;
+    int last_karma = numeric_limits<int>::min();
+    Database::KarmaCursor karma_cursor;
+    while (!karma_cursor.Exhausted()) {
+        karma_cursor = db.PageByKarma(-100, 100, 10, karma_cursor, [&](const Record& record) {
+            ASSERT(last_karma <= record.karma);
+            last_karma = record.karma;
+            ++karma_records;
+            return true;
+        });
+    }
+    ASSERT_EQUAL(karma_records, db.CountByKarma(-100, 100));
+
+    vector<string> user_ids;
+    Database::UserCursor user_cursor;
+    for (int i = 0; !user_cursor.Exhausted(); ++i) {
+        user_cursor = db.PageByUser("user1", 2, user_cursor, [&user_ids](const Record& record) {
+            user_ids.push_back(record.id);
+            return true;
+        });
+        if (!user_cursor.Exhausted())
+            db.Put({"user1-" + to_string(i), "title", "user1", 2000000 + i, 0});
+    }
+    size_t user_records = 0;
+    db.AllByUser("user1", [&user_records](const Record&) {
+        ++user_records;
+        return true;
+    });
+    ASSERT_EQUAL(user_ids.size(), user_records);
+    ASSERT_EQUAL(set<string>(user_ids.begin(), user_ids.end()).size(), user_ids.size());
+
+    ASSERT(db.PageByUser("nobody", 10, {}, [](const Record&) { return true; }).Exhausted());
+
+    size_t visited = 0;
+    auto stopped = db.PageByTimestamp(0, 1000000, 10, {}, [&visited](const Record&) {
+        return ++visited < 3;
+    });
+    ASSERT(!stopped.Exhausted());
+    db.PageByTimestamp(0, 1000000, 1, stopped, [&visited](const Record&) {
+        ++visited;
+        return true;
+    });
+    ASSERT_EQUAL(visited, 4u);
+}
+
+void TestDeepPaginationSpeed() {
+    Database db;
+    db.BulkLoad(MakeRecords(200000, 59));
+    const size_t page_size = 100;
+    const size_t page_count = 300;
+
+    size_t skipped_total = 0;
+    {
+        LOG_DURATION("300 pages by restart and skip");
+        for (size_t page = 0; page < page_count; ++page) {
+            size_t position = 0;
+            db.RangeByTimestamp(0, 1000000, [&](const Record&) {
+                if (position++ < page * page_size)
+                    return true;
+
+                ++skipped_total;
+                return position < (page + 1) * page_size;
+            });
+        }
+    }
+
+    size_t cursor_total = 0;
+    {
+        LOG_DURATION("300 pages by cursor");
+        Database::TimestampCursor cursor;
+        for (size_t page = 0; page < page_count; ++page) {
+            cursor = db.PageByTimestamp(0, 1000000, page_size, cursor, [&cursor_total](const Record&) {
+                ++cursor_total;
+                return true;
+            });
+        }
+    }
+
+    ASSERT_EQUAL(cursor_total, skipped_total);
+    ASSERT_EQUAL(cursor_total, page_size * page_count);
+}
+
+void TestPartitionedDatabase() {
+    const vector<Record> records = MakeRecords(4000, 61);
+    Database single;
+    PartitionedDatabase partitioned(4);
+    ASSERT_EQUAL(partitioned.ShardCount(), 4u);
+
+    ASSERT_EQUAL(single.PutBatch({records.begin(), records.begin() + 3000}),
+                 partitioned.PutBatch({records.begin(), records.begin() + 3000}));
+    for (size_t i = 3000; i < records.size(); ++i) {
+        ASSERT_EQUAL(single.Put(records[i]), partitioned.Put(records[i]));
+    }
+    ASSERT(!partitioned.Put(records[0]));
+
+    vector<string> erased_ids;
+    for (size_t i = 0; i < records.size(); i += 5) {
+        erased_ids.push_back(records[i].id);
+    }
+    ASSERT_EQUAL(single.EraseBatch(erased_ids), partitioned.EraseBatch(erased_ids));
+    ASSERT(single.Erase(records[1].id) && partitioned.Erase(records[1].id));
+    ASSERT(partitioned.GetById(records[1].id) == nullptr);
+    ASSERT_EQUAL(partitioned.GetById(records[2].id)->user, records[2].user);
+
+    auto collect_keys = [](const auto& db, bool by_karma) {
+        vector<pair<int, string>> keys;
+        auto visit = [&keys, by_karma](const Record& record) {
+            keys.push_back({by_karma ? record.karma : record.timestamp, record.id});
+            return true;
+        };
+        if (by_karma)
+            db.RangeByKarma(-300, 400, visit);
+        else
+            db.RangeByTimestamp(200000, 700000, visit);
+        return keys;
+    };
+
+    for (bool by_karma : {false, true}) {
+        auto expected = collect_keys(single, by_karma);
+        auto merged = collect_keys(partitioned, by_karma);
+        ASSERT(is_sorted(merged.begin(), merged.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first < rhs.first;
+        }));
+
+        sort(expected.begin(), expected.end());
+        sort(merged.begin(), merged.end());
+        ASSERT(merged == expected);
+    }
+
+    size_t user_records = 0;
+    single.AllByUser(records[2].user, [&user_records](const Record&) {
+        ++user_records;
+        return true;
+    });
+    partitioned.AllByUser(records[2].user, [&user_records](const Record&) {
+        --user_records;
+        return true;
+    });
+    ASSERT_EQUAL(user_records, 0u);
+
+    ASSERT_EQUAL(partitioned.CountByTimestamp(0, 500000), single.CountByTimestamp(0, 500000));
+    ASSERT_EQUAL(partitioned.SumKarmaByTimestamp(0, 500000), single.SumKarmaByTimestamp(0, 500000));
+
+    size_t visited = 0;
+    partitioned.RangeByTimestamp(0, 1000000, [&visited](const Record&) {
+        return ++visited < 700;
+    });
+    ASSERT_EQUAL(visited, 700u);
+}
+
+void TestPartitionedSpeed() {
+    const vector<Record> records = MakeRecords(100000, 67);
+
+    for (size_t shard_count : {1, 2, 4, 8}) {
+        PartitionedDatabase db(shard_count);
+        {
+            LOG_DURATION("Ingest 100k records into " + to_string(shard_count) + " shards");
+            db.PutBatch(records);
+        }
+
+        size_t visited = 0;
+        {
+            LOG_DURATION("100 merged range queries over " + to_string(shard_count) + " shards");
+            for (int low = 0; low < 1000000; low += 10000) {
+                db.RangeByTimestamp(low, low + 20000, [&visited](const Record&) {
+                    ++visited;
+                    return true;
+                });
+            }
+        }
+        ASSERT(visited > 0);
+    }
 }
 
 int main() {
@@ -166,5 +1166,30 @@ int main() {
     RUN_TEST(tr, TestRangeBoundaries);
     RUN_TEST(tr, TestSameUser);
     RUN_TEST(tr, TestReplacement);
+    RUN_TEST(tr, TestSortedIndexBlocks);
+    RUN_TEST(tr, TestEarlyStop);
+    RUN_TEST(tr, TestIndexSpeed);
+    RUN_TEST(tr, TestArenaReuse);
+    RUN_TEST(tr, TestDatabaseMove);
+    RUN_TEST(tr, TestMemoryPerRecord);
+    RUN_TEST(tr, TestBatchOperations);
+    RUN_TEST(tr, TestBulkLoadSpeed);
+    RUN_TEST(tr, TestCompositeQueries);
+    RUN_TEST(tr, TestIndexCount);
+    RUN_TEST(tr, TestSelectiveQuerySpeed);
+    RUN_TEST(tr, TestSnapshotIsolation);
+    RUN_TEST(tr, TestConcurrentSnapshots);
+    RUN_TEST(tr, TestPersistenceRecovery);
+    RUN_TEST(tr, TestLogWriteFailure);
+    RUN_TEST(tr, TestPersistenceSpeed);
+    RUN_TEST(tr, TestAggregates);
+    RUN_TEST(tr, TestAggregateSpeed);
+    RUN_TEST(tr, TestColumnarScan);
+    RUN_TEST(tr, TestColumnarScanSpeed);
+    RUN_TEST(tr, TestStringViewLookups);
+    RUN_TEST(tr, TestPageCursors);
+    RUN_TEST(tr, TestDeepPaginationSpeed);
+    RUN_TEST(tr, TestPartitionedDatabase);
+    RUN_TEST(tr, TestPartitionedSpeed);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include "partitioned_database.h"
+
+#include <future>
+#include <stdexcept>
+
+PartitionedDatabase::PartitionedDatabase(size_t shard_count) {
+    if (shard_count == 0)
+        throw invalid_argument("Shard count must be positive");
+
+    shards_.reserve(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(make_unique<Database>());
+    }
+}
+
+template <typename Part, typename Operation>
+size_t PartitionedDatabase::RunOnShards(const vector<Part>& parts, Operation operation) {
+    vector<future<size_t>> results;
+    results.reserve(shards_.size());
+    for (size_t shard = 0; shard < shards_.size(); ++shard) {
+        results.push_back(async(launch::async, [&, shard] {
+            return operation(*shards_[shard], parts[shard]);
+        }));
+    }
+
+    size_t total = 0;
+    for (auto& result : results) {
+        total += result.get();
+    }
+    return total;
+}
+
+bool PartitionedDatabase::Put(const Record& record) {
+    return shards_[ShardOf(record.id)]->Put(record);
+}
+
+const Record* PartitionedDatabase::GetById(string_view id) const {
+    return shards_[ShardOf(id)]->GetById(id);
+}
+
+bool PartitionedDatabase::Erase(string_view id) {
+    return shards_[ShardOf(id)]->Erase(id);
+}
+
+size_t PartitionedDatabase::PutBatch(const vector<Record>& records) {
+    vector<vector<Record>> parts(shards_.size());
+    for (const Record& record : records) {
+        parts[ShardOf(record.id)].push_back(record);
+    }
+
+    return RunOnShards(parts, [](Database& shard, const vector<Record>& part) {
+        return shard.PutBatch(part);
+    });
+}
+
+size_t PartitionedDatabase::BulkLoad(const vector<Record>& records) {
+    vector<vector<Record>> parts(shards_.size());
+    for (const Record& record : records) {
+        parts[ShardOf(record.id)].push_back(record);
+    }
+
+    return RunOnShards(parts, [](Database& shard, const vector<Record>& part) {
+        return shard.BulkLoad(part);
+    });
+}
+
+size_t PartitionedDatabase::EraseBatch(const vector<string>& ids) {
+    vector<vector<string>> parts(shards_.size());
+    for (const string& id : ids) {
+        parts[ShardOf(id)].push_back(id);
+    }
+
+    return RunOnShards(parts, [](Database& shard, const vector<string>& part) {
+        return shard.EraseBatch(part);
+    });
+}
+
+size_t PartitionedDatabase::CountByTimestamp(int low, int high) const {
+    size_t count = 0;
+    for (const auto& shard : shards_) {
+        count += shard->CountByTimestamp(low, high);
+    }
+    return count;
+}
+
+int64_t PartitionedDatabase::SumKarmaByTimestamp(int low, int high) const {
+    int64_t sum = 0;
+    for (const auto& shard : shards_) {
+        sum += shard->SumKarmaByTimestamp(low, high);
+    }
+    return sum;
+}
+
+size_t PartitionedDatabase::ShardOf(string_view id) const {
+    return hash<string_view>{}(id) % shards_.size();
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "database.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Splits records between independent Database shards by id hash. Batched writes run one worker
+// per shard; range queries merge the shards' pages lazily in index order, ties going to the lower shard.
+// Like Database, it expects a single thread to issue writes and queries.
+class PartitionedDatabase {
+public:
+    explicit PartitionedDatabase(size_t shard_count);
+
+    bool Put(const Record& record);
+
+    const Record* GetById(string_view id) const;
+
+    bool Erase(string_view id);
+
+    size_t PutBatch(const vector<Record>& records);
+
+    size_t BulkLoad(const vector<Record>& records);
+
+    size_t EraseBatch(const vector<string>& ids);
+
+    template <typename Callback>
+    void RangeByTimestamp(int low, int high, Callback callback) const {
+        MergeShards<Database::TimestampCursor>(
+                [low, high](const Database& shard, Database::TimestampCursor cursor, auto visit) {
+                    return shard.PageByTimestamp(low, high, kMergePageSize, move(cursor), visit);
+                },
+                [](const Record& record) {
+                    return record.timestamp;
+                },
+                callback);
+    }
+
+    template <typename Callback>
+    void RangeByKarma(int low, int high, Callback callback) const {
+        MergeShards<Database::KarmaCursor>(
+                [low, high](const Database& shard, Database::KarmaCursor cursor, auto visit) {
+                    return shard.PageByKarma(low, high, kMergePageSize, move(cursor), visit);
+                },
+                [](const Record& record) {
+                    return record.karma;
+                },
+                callback);
+    }
+
+    // A user's records have no order across shards, so they come shard by shard
+    template <typename Callback>
+    void AllByUser(string_view user, Callback callback) const {
+        bool stopped = false;
+        for (const auto& shard : shards_) {
+            shard->AllByUser(user, [&](const Record& record) {
+                stopped = !callback(record);
+                return !stopped;
+            });
+
+            if (stopped)
+                return;
+        }
+    }
+
+    size_t CountByTimestamp(int low, int high) const;
+
+    int64_t SumKarmaByTimestamp(int low, int high) const;
+
+    size_t ShardCount() const {
+        return shards_.size();
+    }
+
+private:
+    static constexpr size_t kMergePageSize = 256;
+
+    vector<unique_ptr<Database>> shards_;
+
+    size_t ShardOf(string_view id) const;
+
+    template <typename Part, typename Operation>
+    size_t RunOnShards(const vector<Part>& parts, Operation operation);
+
+    template <typename Cursor, typename FetchPage, typename KeyOf, typename Callback>
+    void MergeShards(FetchPage fetch_page, KeyOf key_of, Callback callback) const {
+        struct Source {
+            vector<const Record*> page;
+            size_t next = 0;
+            Cursor cursor;
+        };
+
+        vector<Source> sources(shards_.size());
+        auto refill = [&](size_t shard) {
+            Source& source = sources[shard];
+            source.page.clear();
+            source.next = 0;
+            if (!source.cursor.Exhausted()) {
+                source.cursor = fetch_page(*shards_[shard], move(source.cursor), [&source](const Record& record) {
+                    source.page.push_back(&record);
+                    return true;
+                });
+            }
+            return !source.page.empty();
+        };
+
+        using HeapItem = pair<decltype(key_of(declval<const Record&>())), size_t>;
+        priority_queue<HeapItem, vector<HeapItem>, greater<>> heads;
+        for (size_t shard = 0; shard < shards_.size(); ++shard) {
+            if (refill(shard))
+                heads.push({key_of(*sources[shard].page.front()), shard});
+        }
+
+        while (!heads.empty()) {
+            const size_t shard = heads.top().second;
+            heads.pop();
+
+            Source& source = sources[shard];
+            if (!callback(*source.page[source.next++]))
+                return;
+
+            if (source.next < source.page.size() || refill(shard))
+                heads.push({key_of(*source.page[source.next]), shard});
+        }
+    }
+};
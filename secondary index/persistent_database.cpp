@@ -0,0 +1,183 @@
+#include "persistent_database.h"
+#include "file_io.h"
+#include "record_codec.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint64_t kSnapshotMagic = 0x3150414e534244ull;
+    constexpr size_t kSnapshotChunkSize = 1 << 20;
+    // Three length-prefixed strings and two 32-bit ints, all of them empty or zero
+    constexpr size_t kMinEncodedRecordSize = 3 * sizeof(uint32_t) + 2 * sizeof(int32_t);
+
+    struct SnapshotContents {
+        uint64_t generation;
+        vector<Record> records;
+    };
+
+    SnapshotContents LoadSnapshot(const string& path) {
+        const optional<string> data = ReadFile(path);
+        if (!data)
+            return {0, {}};
+
+        string_view rest = *data;
+        uint64_t magic, record_count;
+        SnapshotContents contents;
+        if (!ReadInt(rest, magic) || magic != kSnapshotMagic
+                || !ReadInt(rest, contents.generation) || !ReadInt(rest, record_count))
+            throw runtime_error("Corrupted snapshot header: " + path);
+        if (record_count > rest.size() / kMinEncodedRecordSize)
+            throw runtime_error("Corrupted snapshot record count: " + path);
+
+        const string_view body = rest.substr(0, rest.size() < sizeof(uint32_t) ? 0 : rest.size() - sizeof(uint32_t));
+        contents.records.resize(record_count);
+        for (Record& record : contents.records) {
+            if (!DecodeRecord(rest, record))
+                throw runtime_error("Corrupted snapshot record: " + path);
+        }
+
+        uint32_t checksum;
+        if (!ReadInt(rest, checksum) || !rest.empty() || Checksum(body) != checksum)
+            throw runtime_error("Snapshot checksum mismatch: " + path);
+
+        return contents;
+    }
+
+    // Makes a rename inside directory durable
+    void SyncDirectory(const filesystem::path& directory) {
+        const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd < 0)
+            throw runtime_error("Unable to open the directory " + directory.string());
+
+        const bool synced = fsync(fd) == 0;
+        close(fd);
+        if (!synced)
+            throw runtime_error("Unable to sync the directory " + directory.string());
+    }
+
+    void SaveSnapshot(const string& path, uint64_t generation, const Database& database) {
+        const string temp_path = path + ".tmp";
+        const int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw runtime_error("Unable to create the snapshot " + temp_path);
+
+        string header;
+        WriteInt(header, kSnapshotMagic);
+        WriteInt(header, generation);
+        WriteInt(header, uint64_t{0});
+
+        string chunk = header;
+        uint64_t record_count = 0;
+        uint32_t checksum = Checksum({});
+
+        try {
+            database.RangeByTimestamp(numeric_limits<int>::min(), numeric_limits<int>::max(),
+                                      [&](const Record& record) {
+                                          const size_t record_start = chunk.size();
+                                          EncodeRecord(chunk, record);
+                                          checksum = Checksum(string_view(chunk).substr(record_start), checksum);
+                                          ++record_count;
+
+                                          if (chunk.size() >= kSnapshotChunkSize) {
+                                              WriteAll(fd, chunk);
+                                              chunk.clear();
+                                          }
+                                          return true;
+                                      });
+
+            WriteInt(chunk, checksum);
+            WriteAll(fd, chunk);
+
+            header.resize(header.size() - sizeof(record_count));
+            WriteInt(header, record_count);
+            if (pwrite(fd, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size()) || fsync(fd) != 0)
+                throw runtime_error("Unable to finish the snapshot " + temp_path);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+
+        close(fd);
+        if (rename(temp_path.c_str(), path.c_str()) != 0)
+            throw runtime_error("Unable to install the snapshot " + path);
+        // The log is truncated next, so the new snapshot must not be lost with the rename
+        SyncDirectory(filesystem::path(path).parent_path());
+    }
+}
+
+PersistentDatabase::PersistentDatabase(const string& directory, PersistenceOptions options)
+    : snapshot_path_((filesystem::path(directory) / "snapshot.bin").string())
+    , log_path_((filesystem::path(directory) / "wal.bin").string())
+    , options_(options) {
+    filesystem::create_directories(directory);
+
+    SnapshotContents snapshot = LoadSnapshot(snapshot_path_);
+    database_.BulkLoad(snapshot.records);
+
+    const optional<LogContents> log = ReadLog(log_path_);
+    if (log && log->generation > snapshot.generation)
+        throw runtime_error("Log is newer than the snapshot: " + log_path_);
+
+    size_t append_offset = 0;
+    if (log && log->generation == snapshot.generation) {
+        for (const LogEntry& entry : log->entries) {
+            if (entry.op == LogOp::Put)
+                database_.Put(entry.record);
+            else
+                database_.Erase(entry.record.id);
+        }
+
+        append_offset = log->valid_size;
+        ops_since_checkpoint_ = log->entries.size();
+    }
+
+    log_ = make_unique<WriteAheadLog>(log_path_, snapshot.generation, append_offset, options_.group_commit_size);
+}
+
+bool PersistentDatabase::Put(const Record& record) {
+    if (!database_.Put(record))
+        return false;
+
+    log_->AppendPut(record);
+    CountOperation();
+    return true;
+}
+
+bool PersistentDatabase::Erase(string_view id) {
+    if (database_.GetById(id) == nullptr)
+        return false;
+
+    // id may point into the stored record, so it is logged before the record is released
+    log_->AppendErase(id);
+    database_.Erase(id);
+    CountOperation();
+    return true;
+}
+
+void PersistentDatabase::Checkpoint() {
+    const uint64_t generation = log_->Generation() + 1;
+    log_->Sync();
+
+    SaveSnapshot(snapshot_path_, generation, database_);
+    log_ = make_unique<WriteAheadLog>(log_path_, generation, 0, options_.group_commit_size);
+    ops_since_checkpoint_ = 0;
+}
+
+void PersistentDatabase::Sync() {
+    log_->Sync();
+}
+
+const Database& PersistentDatabase::GetDatabase() const {
+    return database_;
+}
+
+void PersistentDatabase::CountOperation() {
+    if (++ops_since_checkpoint_ >= options_.checkpoint_interval)
+        Checkpoint();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "database.h"
+#include "write_ahead_log.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+struct PersistenceOptions {
+    size_t group_commit_size = 128;
+    size_t checkpoint_interval = 1000000;
+};
+
+// Every successful Put and Erase is appended to a write-ahead log that is fsynced once per
+// group_commit_size entries. A checkpoint writes a compact snapshot and starts a new log
+// generation; recovery loads the snapshot and replays the log of the same generation.
+class PersistentDatabase {
+public:
+    explicit PersistentDatabase(const string& directory, PersistenceOptions options = {});
+
+    bool Put(const Record& record);
+
+    bool Erase(string_view id);
+
+    void Checkpoint();
+
+    void Sync();
+
+    const Database& GetDatabase() const;
+
+private:
+    string snapshot_path_;
+    string log_path_;
+    PersistenceOptions options_;
+    Database database_;
+    unique_ptr<WriteAheadLog> log_;
+    size_t ops_since_checkpoint_ = 0;
+
+    void CountOperation();
+};
@@ -0,0 +1,8 @@
+#include "record.h"
+
+#include <tuple>
+
+bool operator<(const Record& lhs, const Record& rhs) {
+    return tie(lhs.id, lhs.title, lhs.user, lhs.timestamp, lhs.karma)
+        < tie(rhs.id, rhs.title, rhs.user, rhs.timestamp, rhs.karma);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+struct Record {
+    string id;
+    string title;
+    string user;
+    int timestamp;
+    int karma;
+};
+
+bool operator<(const Record& lhs, const Record& rhs);
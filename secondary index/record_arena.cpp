@@ -0,0 +1,30 @@
+#include "record_arena.h"
+
+Record* RecordArena::Allocate(const Record& record) {
+    Record* slot;
+
+    if (!free_list_.empty()) {
+        slot = free_list_.back();
+        free_list_.pop_back();
+    } else {
+        if (used_in_last_page_ == kPageSize) {
+            pages_.push_back(make_unique<Record[]>(kPageSize));
+            used_in_last_page_ = 0;
+        }
+        slot = &pages_.back()[used_in_last_page_++];
+    }
+
+    *slot = record;
+    return slot;
+}
+
+void RecordArena::Free(Record* record) {
+    *record = Record{};
+    free_list_.push_back(record);
+}
+
+void RecordArena::Clear() {
+    pages_.clear();
+    used_in_last_page_ = kPageSize;
+    free_list_.clear();
+}
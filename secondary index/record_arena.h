@@ -0,0 +1,24 @@
+#pragma once
+
+#include "record.h"
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+class RecordArena {
+public:
+    Record* Allocate(const Record& record);
+
+    void Free(Record* record);
+
+    void Clear();
+
+private:
+    static constexpr size_t kPageSize = 1024;
+
+    vector<unique_ptr<Record[]>> pages_;
+    size_t used_in_last_page_ = kPageSize;
+    vector<Record*> free_list_;
+};
@@ -0,0 +1,42 @@
+#include "record_codec.h"
+
+void WriteString(string& output, string_view value) {
+    WriteInt(output, static_cast<uint32_t>(value.size()));
+    output.append(value);
+}
+
+bool ReadString(string_view& input, string& value) {
+    uint32_t size;
+    if (!ReadInt(input, size) || input.size() < size)
+        return false;
+
+    value.assign(input.data(), size);
+    input.remove_prefix(size);
+    return true;
+}
+
+void EncodeRecord(string& output, const Record& record) {
+    WriteString(output, record.id);
+    WriteString(output, record.title);
+    WriteString(output, record.user);
+    WriteInt(output, static_cast<int32_t>(record.timestamp));
+    WriteInt(output, static_cast<int32_t>(record.karma));
+}
+
+bool DecodeRecord(string_view& input, Record& record) {
+    int32_t timestamp, karma;
+    if (!ReadString(input, record.id) || !ReadString(input, record.title) || !ReadString(input, record.user)
+            || !ReadInt(input, timestamp) || !ReadInt(input, karma))
+        return false;
+
+    record.timestamp = timestamp;
+    record.karma = karma;
+    return true;
+}
+
+uint32_t Checksum(string_view data, uint32_t hash) {
+    for (char c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "record.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+template <typename Int>
+void WriteInt(string& output, Int value) {
+    output.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename Int>
+bool ReadInt(string_view& input, Int& value) {
+    if (input.size() < sizeof(value))
+        return false;
+
+    memcpy(&value, input.data(), sizeof(value));
+    input.remove_prefix(sizeof(value));
+    return true;
+}
+
+void WriteString(string& output, string_view value);
+
+bool ReadString(string_view& input, string& value);
+
+void EncodeRecord(string& output, const Record& record);
+
+bool DecodeRecord(string_view& input, Record& record);
+
+uint32_t Checksum(string_view data, uint32_t hash = 2166136261u);
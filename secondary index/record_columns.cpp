@@ -0,0 +1,28 @@
+#include "record_columns.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+RecordColumns::RecordColumns(vector<int> timestamps, vector<int> karmas)
+    : timestamps_(move(timestamps)), karmas_(move(karmas)) {
+    if (timestamps_.size() != karmas_.size())
+        throw invalid_argument("Column sizes differ");
+}
+
+int64_t RecordColumns::SumKarma(int timestamp_low, int timestamp_high, int karma_low, int karma_high) const {
+    int64_t sum = 0;
+    ScanColumns(timestamp_low, timestamp_high, karma_low, karma_high, [&sum](int, int karma) {
+        sum += karma;
+        return true;
+    });
+    return sum;
+}
+
+pair<size_t, size_t> RecordColumns::RowRange(int timestamp_low, int timestamp_high) const {
+    if (timestamp_high < timestamp_low)
+        return {0, 0};
+
+    const auto begin = lower_bound(timestamps_.begin(), timestamps_.end(), timestamp_low);
+    const auto end = upper_bound(begin, timestamps_.end(), timestamp_high);
+    return {begin - timestamps_.begin(), end - timestamps_.begin()};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Struct-of-arrays copy of the int fields, sorted by timestamp. It is a projection taken at one
+// moment: later writes to the indexes it was built from are not reflected.
+class RecordColumns {
+public:
+    RecordColumns() = default;
+
+    RecordColumns(vector<int> timestamps, vector<int> karmas);
+
+    // Calls callback(timestamp, karma) in timestamp order for rows inside both ranges
+    template <typename Callback>
+    void ScanColumns(int timestamp_low, int timestamp_high, int karma_low, int karma_high,
+                     Callback callback) const {
+        const auto [begin, end] = RowRange(timestamp_low, timestamp_high);
+        size_t row = begin;
+
+        for (; row + kGroupSize <= end; row += kGroupSize) {
+            for (uint32_t mask = MatchGroup(karmas_.data() + row, karma_low, karma_high); mask != 0;
+                    mask &= mask - 1) {
+                const size_t match = row + LowestBit(mask);
+                if (!callback(timestamps_[match], karmas_[match]))
+                    return;
+            }
+        }
+
+        for (; row < end; ++row) {
+            if (karmas_[row] >= karma_low && karmas_[row] <= karma_high
+                    && !callback(timestamps_[row], karmas_[row]))
+                return;
+        }
+    }
+
+    int64_t SumKarma(int timestamp_low, int timestamp_high, int karma_low, int karma_high) const;
+
+    size_t Size() const {
+        return timestamps_.size();
+    }
+
+private:
+    static constexpr size_t kGroupSize = 16;
+
+    vector<int> timestamps_;
+    vector<int> karmas_;
+
+    pair<size_t, size_t> RowRange(int timestamp_low, int timestamp_high) const;
+
+    static size_t LowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#else
+        size_t bit = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            ++bit;
+        }
+        return bit;
+#endif
+    }
+
+    // Bit i is set when values[i] lies in [low, high]
+#ifdef __SSE2__
+    static uint32_t MatchGroup(const int* values, int low, int high) {
+        const __m128i lows = _mm_set1_epi32(low);
+        const __m128i highs = _mm_set1_epi32(high);
+        uint32_t outside = 0;
+
+        for (size_t i = 0; i < kGroupSize; i += 4) {
+            const __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+            const __m128i out_of_range = _mm_or_si128(_mm_cmplt_epi32(group, lows), _mm_cmpgt_epi32(group, highs));
+            outside |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(out_of_range))) << i;
+        }
+
+        return ~outside & 0xFFFF;
+    }
+#else
+    static uint32_t MatchGroup(const int* values, int low, int high) {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < kGroupSize; ++i) {
+            mask |= static_cast<uint32_t>(values[i] >= low && values[i] <= high) << i;
+        }
+        return mask;
+    }
+#endif
+};
@@ -0,0 +1,68 @@
+#include "record_indexes.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+    template <typename Index>
+    optional<int> Percentile(const Index& index, double percentile) {
+        if (index.Size() == 0)
+            return nullopt;
+
+        const auto rank = static_cast<size_t>(ceil(percentile / 100 * index.Size()));
+        return index.KeyAtRank(clamp<size_t>(rank, 1, index.Size()) - 1);
+    }
+}
+
+size_t RecordIndexes::CountByTimestamp(int low, int high) const {
+    return timestamp_index.Count(low, high);
+}
+
+size_t RecordIndexes::CountByKarma(int low, int high) const {
+    return karma_index.Count(low, high);
+}
+
+int64_t RecordIndexes::SumKarmaByTimestamp(int low, int high) const {
+    return timestamp_index.Sum(low, high);
+}
+
+size_t RecordIndexes::TimestampRank(int timestamp) const {
+    return timestamp_index.Rank(timestamp);
+}
+
+optional<int> RecordIndexes::TimestampPercentile(double percentile) const {
+    return Percentile(timestamp_index, percentile);
+}
+
+optional<int> RecordIndexes::KarmaPercentile(double percentile) const {
+    return Percentile(karma_index, percentile);
+}
+
+vector<pair<string, int64_t>> RecordIndexes::TopUsersByKarma(size_t count) const {
+    vector<pair<string, int64_t>> result;
+    if (count == 0)
+        return result;
+
+    user_karma_index.ForEachDescending([&](const pair<StringInterner::Handle, int64_t>& user_karma) {
+        result.push_back({users->Name(user_karma.first), user_karma.second});
+        return result.size() < count;
+    });
+
+    return result;
+}
+
+RecordColumns RecordIndexes::Columns() const {
+    vector<int> timestamps;
+    vector<int> karmas;
+    timestamps.reserve(timestamp_index.Size());
+    karmas.reserve(timestamp_index.Size());
+
+    timestamp_index.ForEachInRange(numeric_limits<int>::min(), numeric_limits<int>::max(),
+                                   [&](const Record* record) {
+                                       timestamps.push_back(record->timestamp);
+                                       karmas.push_back(record->karma);
+                                       return true;
+                                   });
+
+    return {move(timestamps), move(karmas)};
+}
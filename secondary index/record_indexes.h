@@ -0,0 +1,193 @@
+#pragma once
+
+#include "record.h"
+#include "record_columns.h"
+#include "sorted_index.h"
+#include "string_interner.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Opaque position in one index: the (key, seq) of the last record handed out. Resuming looks up
+// the entry after it, so pages neither repeat nor skip records when others are inserted or erased.
+template <typename Key>
+class PageCursor {
+public:
+    bool Exhausted() const {
+        return exhausted_;
+    }
+
+private:
+    friend class RecordIndexes;
+
+    optional<pair<Key, uint64_t>> last_;
+    bool exhausted_ = false;
+};
+
+class RecordIndexes {
+public:
+    using TimestampCursor = PageCursor<int>;
+    using KarmaCursor = PageCursor<int>;
+    // User queries run on the (user, timestamp) index, so a user's records come in timestamp order
+    using UserTimestamp = pair<StringInterner::Handle, int>;
+    using UserCursor = PageCursor<UserTimestamp>;
+
+    template <typename Callback>
+    void RangeByTimestamp(int low, int high, Callback callback) const {
+        timestamp_index.ForEachInRange(low, high, [&callback](const Record* record) {
+            return callback(*record);
+        });
+    }
+
+    template <typename Callback>
+    void RangeByKarma(int low, int high, Callback callback) const {
+        karma_index.ForEachInRange(low, high, [&callback](const Record* record) {
+            return callback(*record);
+        });
+    }
+
+    template <typename Callback>
+    void AllByUser(string_view user, Callback callback) const {
+        auto user_handle = users->Find(user);
+
+        if (!user_handle)
+            return;
+
+        RangeByUserAndTimestamp(*user_handle, numeric_limits<int>::min(), numeric_limits<int>::max(), callback);
+    }
+
+    template <typename Callback>
+    void RangeByUserAndTimestamp(string_view user, int low, int high, Callback callback) const {
+        auto user_handle = users->Find(user);
+
+        if (!user_handle)
+            return;
+
+        RangeByUserAndTimestamp(*user_handle, low, high, callback);
+    }
+
+    // Drives the scan from whichever index matches fewer entries and checks the other bound on the record
+    template <typename Callback>
+    void RangeByKarmaAndTimestamp(int karma_low, int karma_high, int timestamp_low, int timestamp_high,
+                                  Callback callback) const {
+        if (karma_index.Count(karma_low, karma_high)
+                < timestamp_index.Count(timestamp_low, timestamp_high)) {
+            karma_index.ForEachInRange(karma_low, karma_high, [&](const Record* record) {
+                if (record->timestamp < timestamp_low || record->timestamp > timestamp_high)
+                    return true;
+
+                return callback(*record);
+            });
+        } else {
+            timestamp_index.ForEachInRange(timestamp_low, timestamp_high, [&](const Record* record) {
+                if (record->karma < karma_low || record->karma > karma_high)
+                    return true;
+
+                return callback(*record);
+            });
+        }
+    }
+
+    // Each Page* call visits at most page_size records after cursor and returns the cursor for the next page
+    template <typename Callback>
+    TimestampCursor PageByTimestamp(int low, int high, size_t page_size, TimestampCursor cursor,
+                                    Callback callback) const {
+        return Page(timestamp_index, low, high, page_size, move(cursor), callback);
+    }
+
+    template <typename Callback>
+    KarmaCursor PageByKarma(int low, int high, size_t page_size, KarmaCursor cursor, Callback callback) const {
+        return Page(karma_index, low, high, page_size, move(cursor), callback);
+    }
+
+    template <typename Callback>
+    UserCursor PageByUser(string_view user, size_t page_size, UserCursor cursor, Callback callback) const {
+        auto user_handle = users->Find(user);
+
+        if (!user_handle) {
+            cursor.exhausted_ = true;
+            return cursor;
+        }
+
+        return Page(user_timestamp_index, UserTimestamp{*user_handle, numeric_limits<int>::min()},
+                    UserTimestamp{*user_handle, numeric_limits<int>::max()}, page_size, move(cursor), callback);
+    }
+
+    size_t CountByTimestamp(int low, int high) const;
+
+    size_t CountByKarma(int low, int high) const;
+
+    int64_t SumKarmaByTimestamp(int low, int high) const;
+
+    size_t TimestampRank(int timestamp) const;
+
+    optional<int> TimestampPercentile(double percentile) const;
+
+    optional<int> KarmaPercentile(double percentile) const;
+
+    vector<pair<string, int64_t>> TopUsersByKarma(size_t count) const;
+
+    RecordColumns Columns() const;
+
+protected:
+    struct KarmaWeight {
+        int64_t operator()(const Record* record) const {
+            return record->karma;
+        }
+    };
+
+    template <typename Type>
+    using Index = SortedIndex<Type, const Record*>;
+
+    using TimestampIndex = SortedIndex<int, const Record*, KarmaWeight>;
+    shared_ptr<StringInterner> users = make_shared<StringInterner>();
+    TimestampIndex timestamp_index;
+    Index<int> karma_index;
+    Index<UserTimestamp> user_timestamp_index;
+    SortedIndex<int64_t, pair<StringInterner::Handle, int64_t>> user_karma_index;
+
+private:
+    template <typename Callback>
+    void RangeByUserAndTimestamp(StringInterner::Handle user, int low, int high, Callback& callback) const {
+        user_timestamp_index.ForEachInRange({user, low}, {user, high}, [&callback](const Record* record) {
+            return callback(*record);
+        });
+    }
+
+    template <typename Key, typename Weigher, typename Callback>
+    static PageCursor<Key> Page(const SortedIndex<Key, const Record*, Weigher>& index, const Key& low,
+                                const Key& high, size_t page_size, PageCursor<Key> cursor, Callback callback) {
+        if (cursor.exhausted_ || page_size == 0)
+            return cursor;
+
+        Key from_key = low;
+        uint64_t from_seq = 0;
+        if (cursor.last_ && !(cursor.last_->first < low)) {
+            from_key = cursor.last_->first;
+            from_seq = cursor.last_->second + 1;
+        }
+
+        size_t visited = 0;
+        bool stopped = false;
+        index.ForEachEntryFrom(from_key, from_seq, high, [&](const auto& entry) {
+            if (visited == page_size)
+                return false;
+
+            cursor.last_ = {entry.key, entry.seq};
+            ++visited;
+            stopped = !callback(*entry.value);
+            return !stopped;
+        });
+
+        cursor.exhausted_ = visited < page_size && !stopped;
+        return cursor;
+    }
+};
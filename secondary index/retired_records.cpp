@@ -0,0 +1,28 @@
+#include "retired_records.h"
+
+RetiredRecords::RetiredRecords(shared_ptr<RecordPool> pool) : pool_(move(pool)) {
+}
+
+RetiredRecords::~RetiredRecords() {
+    {
+        lock_guard<mutex> lock(pool_->guard);
+        for (Record* record : records_) {
+            pool_->arena.Free(record);
+        }
+    }
+
+    auto next = move(next_);
+    while (next && next.use_count() == 1) {
+        auto after = move(next->next_);
+        next.reset();
+        next = move(after);
+    }
+}
+
+void RetiredRecords::Add(Record* record) {
+    records_.push_back(record);
+}
+
+void RetiredRecords::SetNext(shared_ptr<RetiredRecords> next) {
+    next_ = move(next);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "record_arena.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+struct RecordPool {
+    mutex guard;
+    RecordArena arena;
+};
+
+// Records erased after a snapshot was published. Each list keeps the next one alive,
+// so a record returns to the pool only once every snapshot that could see it is gone.
+class RetiredRecords {
+public:
+    explicit RetiredRecords(shared_ptr<RecordPool> pool);
+
+    RetiredRecords(const RetiredRecords&) = delete;
+    RetiredRecords& operator=(const RetiredRecords&) = delete;
+
+    ~RetiredRecords();
+
+    void Add(Record* record);
+
+    void SetNext(shared_ptr<RetiredRecords> next);
+
+private:
+    shared_ptr<RecordPool> pool_;
+    vector<Record*> records_;
+    shared_ptr<RetiredRecords> next_;
+};
@@ -0,0 +1,405 @@
+#pragma once
+
+#include "fenwick_tree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+using namespace std;
+
+struct NoWeight {
+    template <typename Value>
+    int64_t operator()(const Value&) const {
+        return 0;
+    }
+};
+
+// Blocks are shared between copies and cloned on first write, so copying an index is a cheap snapshot.
+// Per-block entry counts and Weigher sums are kept in Fenwick trees for O(log n) rank and range aggregates.
+template <typename Key, typename Value, typename Weigher = NoWeight>
+class SortedIndex {
+public:
+    struct Entry {
+        Key key;
+        uint64_t seq;
+        Value value;
+    };
+
+    void Insert(Key key, uint64_t seq, Value value) {
+        const bool first_block = blocks_.empty();
+        if (first_block) {
+            blocks_.push_back(make_shared<Block>());
+            block_mins_.push_back({key, seq});
+            block_weights_.push_back(0);
+        }
+
+        const size_t block_index = FindBlock(key, seq);
+        Block& block = MutableBlock(block_index);
+        auto it = LowerBoundInBlock(block, key, seq);
+
+        if (it == block.begin())
+            block_mins_[block_index] = {key, seq};
+
+        const int64_t weight = Weigher{}(value);
+        block.insert(it, {move(key), seq, move(value)});
+        block_weights_[block_index] += weight;
+        ++size_;
+
+        if (block.size() > kBlockSize) {
+            SplitBlock(block_index);
+            RebuildTrees();
+        } else if (first_block) {
+            RebuildTrees();
+        } else {
+            block_size_tree_.Add(block_index, 1);
+            AddWeight(block_index, weight);
+        }
+    }
+
+    bool Erase(const Key& key, uint64_t seq) {
+        if (blocks_.empty())
+            return false;
+
+        const size_t block_index = FindBlock(key, seq);
+        const size_t offset = LowerBoundInBlock(*blocks_[block_index], key, seq) - blocks_[block_index]->begin();
+
+        if (offset == blocks_[block_index]->size()
+                || (*blocks_[block_index])[offset].seq != seq || (*blocks_[block_index])[offset].key != key)
+            return false;
+
+        Block& block = MutableBlock(block_index);
+        const int64_t weight = Weigher{}(block[offset].value);
+        block.erase(block.begin() + offset);
+        block_weights_[block_index] -= weight;
+        --size_;
+
+        if (block.empty()) {
+            blocks_.erase(blocks_.begin() + block_index);
+            block_mins_.erase(block_mins_.begin() + block_index);
+            block_weights_.erase(block_weights_.begin() + block_index);
+            RebuildTrees();
+        } else {
+            block_mins_[block_index] = {block.front().key, block.front().seq};
+            if (MaybeMergeBlock(block_index)) {
+                RebuildTrees();
+            } else {
+                block_size_tree_.Add(block_index, -1);
+                AddWeight(block_index, -weight);
+            }
+        }
+
+        return true;
+    }
+
+    void InsertBatch(vector<Entry> entries) {
+        sort(entries.begin(), entries.end(), EntryLess);
+
+        if (entries.size() * kBatchRebuildRatio < size_) {
+            for (Entry& entry : entries) {
+                Insert(move(entry.key), entry.seq, move(entry.value));
+            }
+            return;
+        }
+
+        vector<Entry> existing = ExtractAll();
+        vector<Entry> merged;
+        merged.reserve(existing.size() + entries.size());
+        merge(make_move_iterator(existing.begin()), make_move_iterator(existing.end()),
+              make_move_iterator(entries.begin()), make_move_iterator(entries.end()),
+              back_inserter(merged), EntryLess);
+
+        Assign(move(merged));
+    }
+
+    void EraseBatch(vector<pair<Key, uint64_t>> keys) {
+        sort(keys.begin(), keys.end());
+
+        if (keys.size() * kBatchRebuildRatio < size_) {
+            for (const auto& [key, seq] : keys) {
+                Erase(key, seq);
+            }
+            return;
+        }
+
+        vector<Entry> kept;
+        kept.reserve(size_);
+        auto key_it = keys.begin();
+        for (Entry& entry : ExtractAll()) {
+            while (key_it != keys.end() && tie(key_it->first, key_it->second) < tie(entry.key, entry.seq))
+                ++key_it;
+
+            if (key_it == keys.end() || tie(entry.key, entry.seq) < tie(key_it->first, key_it->second))
+                kept.push_back(move(entry));
+        }
+
+        Assign(move(kept));
+    }
+
+    void Assign(vector<Entry> sorted_entries) {
+        Clear();
+        size_ = sorted_entries.size();
+
+        for (size_t begin = 0; begin < sorted_entries.size(); begin += kBulkFillSize) {
+            const size_t end = min(begin + kBulkFillSize, sorted_entries.size());
+
+            auto block = make_shared<Block>();
+            block->reserve(kBlockSize + 1);
+            block->insert(block->end(), make_move_iterator(sorted_entries.begin() + begin),
+                          make_move_iterator(sorted_entries.begin() + end));
+
+            block_mins_.push_back({block->front().key, block->front().seq});
+            block_weights_.push_back(BlockWeight(*block));
+            blocks_.push_back(move(block));
+        }
+
+        RebuildTrees();
+    }
+
+    void Clear() {
+        blocks_.clear();
+        block_mins_.clear();
+        block_weights_.clear();
+        RebuildTrees();
+        size_ = 0;
+    }
+
+    template <typename Callback>
+    void ForEachInRange(const Key& low, const Key& high, Callback callback) const {
+        ForEachEntryFrom(low, 0, high, [&callback](const Entry& entry) {
+            return callback(entry.value);
+        });
+    }
+
+    // Visits entries from the first one not less than (key, seq) up to high, so a scan can resume
+    // after a remembered (key, seq) regardless of inserts and erases made in between
+    template <typename Callback>
+    void ForEachEntryFrom(const Key& key, uint64_t seq, const Key& high, Callback callback) const {
+        auto [block_index, offset] = LowerBound(key, seq);
+
+        for (; block_index < blocks_.size(); ++block_index, offset = 0) {
+            const Block& block = *blocks_[block_index];
+
+            for (; offset < block.size(); ++offset) {
+                if (high < block[offset].key)
+                    return;
+
+                if (!callback(block[offset]))
+                    return;
+            }
+        }
+    }
+
+    template <typename Callback>
+    void ForEachDescending(Callback callback) const {
+        for (size_t block_index = blocks_.size(); block_index > 0; --block_index) {
+            const Block& block = *blocks_[block_index - 1];
+
+            for (size_t offset = block.size(); offset > 0; --offset) {
+                if (!callback(block[offset - 1].value))
+                    return;
+            }
+        }
+    }
+
+    size_t Count(const Key& low, const Key& high) const {
+        if (high < low)
+            return 0;
+
+        return RankOf(LowerBound(high, numeric_limits<uint64_t>::max())) - RankOf(LowerBound(low, 0));
+    }
+
+    int64_t Sum(const Key& low, const Key& high) const {
+        if (high < low)
+            return 0;
+
+        return WeightBefore(LowerBound(high, numeric_limits<uint64_t>::max())) - WeightBefore(LowerBound(low, 0));
+    }
+
+    size_t Rank(const Key& key) const {
+        return RankOf(LowerBound(key, 0));
+    }
+
+    optional<Key> KeyAtRank(size_t rank) const {
+        if (rank >= size_)
+            return nullopt;
+
+        const size_t block_index = block_size_tree_.FindPrefixAbove(rank);
+        return (*blocks_[block_index])[rank - block_size_tree_.Prefix(block_index)].key;
+    }
+
+    template <typename Callback>
+    void ForEachEqual(const Key& key, Callback callback) const {
+        ForEachInRange(key, key, callback);
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    static constexpr size_t kBlockSize = 256;
+    static constexpr size_t kBulkFillSize = kBlockSize * 3 / 4;
+    static constexpr size_t kBatchRebuildRatio = 8;
+
+    using Block = vector<Entry>;
+
+    static constexpr bool kWeighted = !is_same_v<Weigher, NoWeight>;
+
+    vector<shared_ptr<Block>> blocks_;
+    vector<pair<Key, uint64_t>> block_mins_;
+    vector<int64_t> block_weights_;
+    FenwickTree block_size_tree_;
+    FenwickTree block_weight_tree_;
+    size_t size_ = 0;
+
+    struct Position {
+        size_t block;
+        size_t offset;
+    };
+
+    Position LowerBound(const Key& key, uint64_t seq) const {
+        if (blocks_.empty())
+            return {0, 0};
+
+        const size_t block_index = FindBlock(key, seq);
+        const Block& block = *blocks_[block_index];
+        const size_t offset = LowerBoundInBlock(block, key, seq) - block.begin();
+
+        if (offset == block.size())
+            return {block_index + 1, 0};
+
+        return {block_index, offset};
+    }
+
+    size_t RankOf(Position position) const {
+        return block_size_tree_.Prefix(position.block) + position.offset;
+    }
+
+    int64_t WeightBefore(Position position) const {
+        if constexpr (!kWeighted) {
+            return 0;
+        } else {
+            int64_t weight = block_weight_tree_.Prefix(position.block);
+            if (position.block < blocks_.size()) {
+                const Block& block = *blocks_[position.block];
+                for (size_t offset = 0; offset < position.offset; ++offset) {
+                    weight += Weigher{}(block[offset].value);
+                }
+            }
+            return weight;
+        }
+    }
+
+    static int64_t BlockWeight(const Block& block) {
+        int64_t weight = 0;
+        if constexpr (kWeighted) {
+            for (const Entry& entry : block) {
+                weight += Weigher{}(entry.value);
+            }
+        }
+        return weight;
+    }
+
+    void AddWeight(size_t block_index, int64_t weight) {
+        if constexpr (kWeighted)
+            block_weight_tree_.Add(block_index, weight);
+    }
+
+    void RebuildTrees() {
+        vector<int64_t> block_sizes(blocks_.size());
+        for (size_t i = 0; i < blocks_.size(); ++i) {
+            block_sizes[i] = blocks_[i]->size();
+        }
+
+        block_size_tree_.Assign(block_sizes);
+        if constexpr (kWeighted)
+            block_weight_tree_.Assign(block_weights_);
+    }
+
+    static bool EntryLess(const Entry& lhs, const Entry& rhs) {
+        return tie(lhs.key, lhs.seq) < tie(rhs.key, rhs.seq);
+    }
+
+    vector<Entry> ExtractAll() {
+        vector<Entry> entries;
+        entries.reserve(size_);
+
+        atomic_thread_fence(memory_order_acquire);
+        for (auto& block : blocks_) {
+            if (block.use_count() == 1)
+                entries.insert(entries.end(), make_move_iterator(block->begin()), make_move_iterator(block->end()));
+            else
+                entries.insert(entries.end(), block->begin(), block->end());
+        }
+
+        Clear();
+        return entries;
+    }
+
+    size_t FindBlock(const Key& key, uint64_t seq) const {
+        auto it = upper_bound(block_mins_.begin(), block_mins_.end(), tie(key, seq),
+                              [](const auto& lhs, const auto& rhs) {
+                                  return lhs < tie(rhs.first, rhs.second);
+                              });
+
+        return it == block_mins_.begin() ? 0 : it - block_mins_.begin() - 1;
+    }
+
+    Block& MutableBlock(size_t block_index) {
+        if (blocks_[block_index].use_count() > 1)
+            blocks_[block_index] = make_shared<Block>(*blocks_[block_index]);
+        else
+            atomic_thread_fence(memory_order_acquire);
+
+        return *blocks_[block_index];
+    }
+
+    static typename Block::const_iterator LowerBoundInBlock(
+            const Block& block, const Key& key, uint64_t seq
+    ) {
+        return lower_bound(block.begin(), block.end(), tie(key, seq),
+                           [](const Entry& lhs, const auto& rhs) {
+                               return tie(lhs.key, lhs.seq) < rhs;
+                           });
+    }
+
+    void SplitBlock(size_t block_index) {
+        Block& block = MutableBlock(block_index);
+        auto upper = make_shared<Block>(make_move_iterator(block.begin() + block.size() / 2),
+                                        make_move_iterator(block.end()));
+        block.erase(block.begin() + block.size() / 2, block.end());
+
+        const int64_t upper_weight = BlockWeight(*upper);
+        block_weights_[block_index] -= upper_weight;
+        block_weights_.insert(block_weights_.begin() + block_index + 1, upper_weight);
+        block_mins_.insert(block_mins_.begin() + block_index + 1, {upper->front().key, upper->front().seq});
+        blocks_.insert(blocks_.begin() + block_index + 1, move(upper));
+    }
+
+    bool MaybeMergeBlock(size_t block_index) {
+        if (block_index + 1 >= blocks_.size())
+            return false;
+
+        const Block& next_block = *blocks_[block_index + 1];
+
+        if (blocks_[block_index]->size() >= kBlockSize / 4
+                || blocks_[block_index]->size() + next_block.size() > kBlockSize)
+            return false;
+
+        Block& block = MutableBlock(block_index);
+        block.insert(block.end(), next_block.begin(), next_block.end());
+        block_weights_[block_index] += block_weights_[block_index + 1];
+        blocks_.erase(blocks_.begin() + block_index + 1);
+        block_mins_.erase(block_mins_.begin() + block_index + 1);
+        block_weights_.erase(block_weights_.begin() + block_index + 1);
+        return true;
+    }
+};
@@ -0,0 +1,31 @@
+#include "string_interner.h"
+
+#include <mutex>
+
+StringInterner::Handle StringInterner::Intern(string_view value) {
+    if (auto handle = Find(value))
+        return *handle;
+
+    unique_lock<shared_mutex> lock(mutex_);
+    if (auto it = handles_.find(value); it != handles_.end())
+        return it->second;
+
+    const auto handle = static_cast<Handle>(names_.size());
+    handles_.emplace(names_.emplace_back(value), handle);
+    return handle;
+}
+
+optional<StringInterner::Handle> StringInterner::Find(string_view value) const {
+    shared_lock<shared_mutex> lock(mutex_);
+    auto it = handles_.find(value);
+
+    if (it == handles_.end())
+        return nullopt;
+
+    return it->second;
+}
+
+string StringInterner::Name(Handle handle) const {
+    shared_lock<shared_mutex> lock(mutex_);
+    return names_.at(handle);
+}
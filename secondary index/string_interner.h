@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+class StringInterner {
+public:
+    using Handle = uint32_t;
+
+    Handle Intern(string_view value);
+
+    optional<Handle> Find(string_view value) const;
+
+    string Name(Handle handle) const;
+
+private:
+    mutable shared_mutex mutex_;
+    unordered_map<string_view, Handle> handles_;
+    deque<string> names_;
+};
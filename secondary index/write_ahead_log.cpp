@@ -0,0 +1,141 @@
+#include "write_ahead_log.h"
+#include "file_io.h"
+#include "record_codec.h"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr uint64_t kLogMagic = 0x314c41574244ull;
+    constexpr size_t kHeaderSize = 2 * sizeof(uint64_t);
+}
+
+optional<LogContents> ReadLog(const string& path) {
+    const optional<string> data = ReadFile(path);
+    if (!data)
+        return nullopt;
+
+    string_view rest = *data;
+
+    uint64_t magic;
+    LogContents contents{0, {}, 0};
+    if (!ReadInt(rest, magic) || magic != kLogMagic || !ReadInt(rest, contents.generation))
+        return nullopt;
+
+    contents.valid_size = kHeaderSize;
+    while (true) {
+        uint32_t size, checksum;
+        if (!ReadInt(rest, size) || rest.size() < size + sizeof(checksum))
+            break;
+
+        string_view payload = rest.substr(0, size);
+        rest.remove_prefix(size);
+        if (!ReadInt(rest, checksum) || payload.empty() || Checksum(payload) != checksum)
+            break;
+
+        LogEntry entry{static_cast<LogOp>(payload.front()), {}};
+        payload.remove_prefix(1);
+
+        const bool decoded = entry.op == LogOp::Put ? DecodeRecord(payload, entry.record)
+                : entry.op == LogOp::Erase && ReadString(payload, entry.record.id);
+        if (!decoded)
+            break;
+
+        contents.entries.push_back(move(entry));
+        contents.valid_size = data->size() - rest.size();
+    }
+
+    return contents;
+}
+
+WriteAheadLog::WriteAheadLog(const string& path, uint64_t generation, size_t append_offset,
+                             size_t group_commit_size)
+    : generation_(generation)
+    , group_commit_size_(max<size_t>(group_commit_size, 1)) {
+    const bool append = append_offset >= kHeaderSize;
+
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+    if (fd_ < 0)
+        throw runtime_error("Unable to open the log " + path);
+
+    if (append) {
+        if (ftruncate(fd_, append_offset) != 0 || lseek(fd_, 0, SEEK_END) < 0) {
+            close(fd_);
+            throw runtime_error("Unable to reopen the log " + path);
+        }
+    } else {
+        WriteInt(buffer_, kLogMagic);
+        WriteInt(buffer_, generation_);
+        try {
+            Sync();
+        } catch (exception&) {
+            close(fd_);
+            throw;
+        }
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    try {
+        Sync();
+    } catch (exception&) {
+    }
+    close(fd_);
+}
+
+void WriteAheadLog::AppendPut(const Record& record) {
+    const size_t entry_start = BeginEntry(LogOp::Put);
+    EncodeRecord(buffer_, record);
+    EndEntry(entry_start);
+}
+
+void WriteAheadLog::AppendErase(string_view id) {
+    const size_t entry_start = BeginEntry(LogOp::Erase);
+    WriteString(buffer_, id);
+    EndEntry(entry_start);
+}
+
+void WriteAheadLog::Sync() {
+    ThrowIfFailed();
+    if (buffer_.empty())
+        return;
+
+    // Stays set if either call throws
+    failed_ = true;
+    WriteAll(fd_, buffer_);
+    if (fdatasync(fd_) != 0)
+        throw runtime_error("Unable to sync the log");
+    failed_ = false;
+
+    buffer_.clear();
+    pending_count_ = 0;
+}
+
+uint64_t WriteAheadLog::Generation() const {
+    return generation_;
+}
+
+void WriteAheadLog::ThrowIfFailed() const {
+    if (failed_)
+        throw runtime_error("The log failed to write and accepts no more entries");
+}
+
+size_t WriteAheadLog::BeginEntry(LogOp op) {
+    ThrowIfFailed();
+    const size_t entry_start = buffer_.size();
+    WriteInt(buffer_, uint32_t{0});
+    buffer_.push_back(static_cast<char>(op));
+    return entry_start;
+}
+
+void WriteAheadLog::EndEntry(size_t entry_start) {
+    const size_t payload_start = entry_start + sizeof(uint32_t);
+    const auto size = static_cast<uint32_t>(buffer_.size() - payload_start);
+    memcpy(&buffer_[entry_start], &size, sizeof(size));
+    WriteInt(buffer_, Checksum(string_view(buffer_).substr(payload_start)));
+
+    if (++pending_count_ >= group_commit_size_)
+        Sync();
+}
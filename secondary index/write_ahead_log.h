@@ -0,0 +1,65 @@
+#pragma once
+
+#include "record.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+enum class LogOp : uint8_t {
+    Put = 1,
+    Erase = 2,
+};
+
+struct LogEntry {
+    LogOp op;
+    Record record;
+};
+
+struct LogContents {
+    uint64_t generation;
+    vector<LogEntry> entries;
+    size_t valid_size;
+};
+
+// Stops at the first torn or corrupted entry; valid_size is where appending may resume
+optional<LogContents> ReadLog(const string& path);
+
+// After a failed write or fdatasync the file may end in a torn entry, so the log refuses every
+// further append and sync instead of writing valid entries behind it that recovery would never reach
+class WriteAheadLog {
+public:
+    // Starts a fresh log unless append_offset points past the header of an existing one
+    WriteAheadLog(const string& path, uint64_t generation, size_t append_offset, size_t group_commit_size);
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog();
+
+    void AppendPut(const Record& record);
+
+    void AppendErase(string_view id);
+
+    void Sync();
+
+    uint64_t Generation() const;
+
+private:
+    int fd_ = -1;
+    uint64_t generation_;
+    size_t group_commit_size_;
+    size_t pending_count_ = 0;
+    string buffer_;
+    bool failed_ = false;
+
+    void ThrowIfFailed() const;
+
+    size_t BeginEntry(LogOp op);
+
+    void EndEntry(size_t entry_start);
+};